@@ -37,6 +37,17 @@ SOFTWARE.
 void rcc_clock_setup_in_hse_8mhz_out_custom(void);
 
 
+// Display on SPI1 with the default pins (see st7789_stm32_spi.h)
+st_display_t display = ST_DISPLAY_SPI1;
+
+#ifdef ST_USE_SPI_DMA
+// DMA1 channel 3 (SPI1 TX) interrupt drives the display's transfer queue
+void dma1_channel3_isr(void)
+{
+	st_dma_isr(&display);
+}
+#endif
+
 /* Set STM32 to 80 MHz. (overclocking for faster performance) */
 static void clock_setup(void)
 {
@@ -51,50 +62,50 @@ int main(void)
 
 	//----------------------------------------------------------
 	//initializing the ili9341 display driver
-	st_init();
+	st_init(&display);
 	//rotating display to default mode
-	//st_rotate_display(0);
+	//st_rotate_display(&display, 0);
 
 	// Fiiling the entire screen with cyan color
-	st_fill_screen(ST_COLOR_CYAN);
+	st_fill_screen(&display, ST_COLOR_CYAN);
 
 	// Fill a rectangle with green yellow
-	st_fill_rect(20, 0, 80, 80, ST_COLOR_PINK);
+	st_fill_rect(&display, 20, 0, 80, 80, ST_COLOR_PINK);
 
 	// Draw a rectangle
-	st_draw_rectangle(5, 160, 50, 50, ST_COLOR_BLACK);
+	st_draw_rectangle(&display, 5, 160, 50, 50, ST_COLOR_BLACK);
 
 	// Write a string with transparent background at (0, 0) position with font `font_microsoft_16`
-	st_draw_string(0, 0, "Hello world", 0, &font_ubuntu_mono_24);
+	st_draw_string(&display, 0, 0, "Hello world", 0, &font_ubuntu_mono_24);
 
 	// Write a few characters at different positions
 	for (int i = 0; i < 10; i++)
-		st_draw_char(rand() % 100 + 5, rand() % 100 + 60, (char)(rand() % 50 + 90), ST_COLOR_RED, 0, &font_ubuntu_mono_24, 0);
+		st_draw_char(&display, rand() % 100 + 5, rand() % 100 + 60, (char)(rand() % 50 + 90), ST_COLOR_RED, 0, &font_ubuntu_mono_24, 0);
 
 	// Write a string with solid background. Text color white, background color dark green
-	st_draw_string_withbg(10, 40, "Hello Solid World", ST_COLOR_WHITE, ST_COLOR_DARKGREEN, &font_ubuntu_mono_24);
+	st_draw_string_withbg(&display, 10, 40, "Hello Solid World", ST_COLOR_WHITE, ST_COLOR_DARKGREEN, &font_ubuntu_mono_24);
 
 	// Draw a line between any two points
-	st_draw_line(4, 18, 200, 150, 1, ST_COLOR_RED);
+	st_draw_line(&display, 4, 18, 200, 150, 1, ST_COLOR_RED);
 
 	// Draw a "thicc" line
-	st_draw_line(180, 2, 20, 220, 5, ST_COLOR_BLUE);
+	st_draw_line(&display, 180, 2, 20, 220, 5, ST_COLOR_BLUE);
 	
 	// Draw some individual pixels in random points
 	for (int i = 0; i < 2000; i++)
-		st_draw_pixel(rand() % 100 + 120, rand() % 100 + 60, ST_COLOR_WHITE + rand() % 100 + 60);
+		st_draw_pixel(&display, rand() % 100 + 120, rand() % 100 + 60, ST_COLOR_WHITE + rand() % 100 + 60);
 
 	/*To fill a specific area multiple times superfast, first set the area then fill it.*/
 	// Set an area on the display to be drawn
-	st_set_address_window(50, 150, 150, 230);
+	st_set_address_window(&display, 50, 150, 150, 230);
 	// Now fill the area many times quickly
 	for (uint16_t i = 0; i < 700; i++)
-		st_fill_color(ST_COLOR_MAROON + i, (100+1) * (150+1));
+		st_fill_color(&display, ST_COLOR_MAROON + i, (100+1) * (150+1));
 
 	// Fill the screen with black
-	st_fill_screen(ST_COLOR_BLACK);
+	st_fill_screen(&display, ST_COLOR_BLACK);
 	// Draw a bitmap image (232 * 216)
-	st_draw_bitmap(4, 12, &img_flag);
+	st_draw_bitmap(&display, 4, 12, &img_flag);
 
 	return 0;
 }
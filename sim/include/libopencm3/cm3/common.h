@@ -0,0 +1,17 @@
+/*
+ * Host build stand-in for <libopencm3/cm3/common.h>.
+ * Pulls in the real header, then routes every MMIO16/MMIO32 register access
+ * through the simulated register file in st7789_sim.c.
+ */
+#ifndef ST_SIM_CM3_COMMON_H_
+#define ST_SIM_CM3_COMMON_H_
+
+#include_next <libopencm3/cm3/common.h>
+#include "st7789_sim.h"
+
+#undef MMIO16
+#undef MMIO32
+#define MMIO16(addr)		(*st_sim_reg((uintptr_t)(addr)))
+#define MMIO32(addr)		(*st_sim_reg((uintptr_t)(addr)))
+
+#endif /* ST_SIM_CM3_COMMON_H_ */
@@ -0,0 +1,18 @@
+/*
+ * Host build stand-in for <libopencm3/cm3/dwt.h>.
+ * The real header defines the cycle counter for ARMv7-M targets only,
+ * so the registers used by the driver are defined here.
+ */
+#ifndef ST_SIM_CM3_DWT_H_
+#define ST_SIM_CM3_DWT_H_
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/memorymap.h>
+
+#define DWT_BASE			(PPBI_BASE + 0x1000)
+#define DWT_CTRL			MMIO32(DWT_BASE + 0x00)
+#define DWT_CYCCNT			MMIO32(DWT_BASE + 0x04)
+
+#define DWT_CTRL_CYCCNTENA	(1 << 0)
+
+#endif /* ST_SIM_CM3_DWT_H_ */
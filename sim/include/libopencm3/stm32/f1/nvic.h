@@ -0,0 +1,14 @@
+/*
+ * Host build stand-in for the generated <libopencm3/stm32/f1/nvic.h>.
+ * Only the DMA1 channels used by SPI1/SPI2 TX are listed.
+ */
+#ifndef ST_SIM_F1_NVIC_H_
+#define ST_SIM_F1_NVIC_H_
+
+#define NVIC_DMA1_CHANNEL3_IRQ		13
+#define NVIC_DMA1_CHANNEL5_IRQ		15
+
+void dma1_channel3_isr(void);
+void dma1_channel5_isr(void);
+
+#endif /* ST_SIM_F1_NVIC_H_ */
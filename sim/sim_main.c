@@ -0,0 +1,528 @@
+/*
+MIT License
+
+Copyright (c) 2020 Avra Mitra
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Runs the display driver against the simulated panel.
+ * For every drawing call, prints what went over the bus (bytes, commands, DMA transfers).
+ * For every scene, compares the final frame with its golden hash and saves it as a PPM image.
+ * Returns non-zero if any frame differs from its golden hash.
+ *
+ * If a drawing change is intended, check the new PPM images and update the golden hashes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "st7789_sim.h"
+#include "st7789_stm32_spi.h"
+#include "font_ubuntu_mono_24.h"
+#include "img_flag.h"
+
+// Directory where PPM frames are written. Set by the Makefile.
+#ifndef ST_SIM_OUT_DIR
+	#define ST_SIM_OUT_DIR		"."
+#endif
+
+st_display_t display = ST_DISPLAY_SPI1;
+
+#ifdef ST_USE_SPI_DMA
+void dma1_channel3_isr(void)
+{
+	st_dma_isr(&display);
+}
+#endif
+
+
+/*
+ * Run `call` and print the bus traffic it caused once it's completely sent
+ */
+#define MEASURE(call)	{ \
+							st_sim_reset_stats(); \
+							call; \
+							st_wait_idle(&display); \
+							_print_stats(#call, st_sim_get_stats(0)); \
+						}
+
+static void _print_stats(const char *call, st_sim_stats_t s)
+{
+	printf("  %-60.60s %8u %6u %6u %6u %6u %4u %4u\n", call, s.bytes, s.cmd_bytes, s.caset, s.raset, s.ramwr, s.dma_transfers, s.irqs);
+	if (s.lost_bytes)
+		printf("  %u bytes lost, sent while the panel was still reading out (RAMRD not ended by CS)\n", s.lost_bytes);
+}
+
+
+/*
+ * Same drawing as the example, without the random parts
+ */
+static void scene_example(void)
+{
+	st_point_t pixels[200];
+	for (int i = 0; i < 200; i++)
+		pixels[i] = (st_point_t){120 + i % 100, 60 + (i * 7) % 100};
+
+	MEASURE(st_fill_screen(&display, ST_COLOR_CYAN));
+	MEASURE(st_fill_rect(&display, 20, 0, 80, 80, ST_COLOR_PINK));
+	MEASURE(st_draw_rectangle(&display, 5, 160, 50, 50, ST_COLOR_BLACK));
+	MEASURE(st_draw_string(&display, 0, 0, "Hello world", 0, &font_ubuntu_mono_24));
+	MEASURE(st_draw_char(&display, 60, 100, 'g', ST_COLOR_RED, 0, &font_ubuntu_mono_24, 0));
+	MEASURE(st_draw_string_withbg(&display, 10, 40, "Hello Solid World", ST_COLOR_WHITE, ST_COLOR_DARKGREEN, &font_ubuntu_mono_24));
+	MEASURE(st_draw_line(&display, 4, 18, 200, 150, 1, ST_COLOR_RED));
+	MEASURE(st_draw_line(&display, 180, 2, 20, 220, 5, ST_COLOR_BLUE));
+	MEASURE(for (int i = 0; i < 200; i++) st_draw_pixel(&display, 120 + i % 100, 60 + (i * 7) % 100, ST_COLOR_WHITE));
+	MEASURE(st_draw_pixels_color(&display, pixels, 200, ST_COLOR_WHITE));
+	MEASURE({ st_set_address_window(&display, 50, 150, 150, 230); st_fill_color(&display, ST_COLOR_MAROON, 101 * 81); });
+}
+
+
+static void scene_bitmap(void)
+{
+	MEASURE(st_fill_screen(&display, ST_COLOR_BLACK));
+	MEASURE(st_draw_bitmap(&display, 4, 12, &img_flag));
+}
+
+
+/*
+ * Panels of a dashboard drawn over a background, once directly and once through the display list
+ */
+static void _dashboard(void)
+{
+	st_fill_screen(&display, ST_COLOR_BLACK);
+	for (uint16_t r = 0; r < 3; r++)
+	{
+		for (uint16_t c = 0; c < 3; c++)
+		{
+			st_fill_rect(&display, 5 + c * 78, 5 + r * 78, 74, 74, ST_COLOR_NAVY);
+			st_fill_rect(&display, 10 + c * 78, 10 + r * 78, 64, 20, ST_COLOR_DARKGREY);
+			st_fill_rect(&display, 10 + c * 78, 40 + r * 78, 30 + r * 10, 30, ST_COLOR_GREEN);
+		}
+	}
+	st_draw_string(&display, 12, 10, "CPU", ST_COLOR_WHITE, &font_ubuntu_mono_24);
+}
+
+static void scene_dashboard(void)
+{
+	MEASURE(_dashboard());
+	#ifdef ST_USE_DISPLAY_LIST
+		MEASURE({ st_begin_list(&display); _dashboard(); st_flush(&display); });
+	#endif
+}
+
+
+/*
+ * Circles, ellipses and rings as spans. Anti-aliased lines, circles and arcs over a known background.
+ */
+static void scene_shapes(void)
+{
+	MEASURE(st_fill_screen(&display, ST_COLOR_NAVY));
+	MEASURE(st_fill_circle(&display, 40, 40, 30, ST_COLOR_ORANGE));
+	MEASURE(st_fill_ring(&display, 200, 40, 30, 20, ST_COLOR_GREENYELLOW));
+	MEASURE(st_draw_ellipse(&display, 120, 140, 100, 70, ST_COLOR_PINK));
+	MEASURE(st_fill_ellipse(&display, 200, 200, 35, 15, ST_COLOR_PURPLE));
+	// Radii far beyond the screen, only their edges show
+	MEASURE(st_fill_ellipse(&display, 120, 30230, 60000, 30000, ST_COLOR_DARKGREEN));
+	MEASURE(st_draw_circle(&display, 30215, 120, 30000, ST_COLOR_PINK));
+	MEASURE(st_draw_line_aa(&display, 10, 20, 200, 100, ST_COLOR_WHITE, ST_COLOR_NAVY));
+	MEASURE(st_draw_line_aa(&display, 10, 230, 60, 30, ST_COLOR_YELLOW, ST_COLOR_NAVY));
+	MEASURE(st_draw_circle_aa(&display, 120, 140, 60, ST_COLOR_GREEN, ST_COLOR_NAVY));
+	MEASURE(st_draw_arc_aa(&display, 120, 140, 40, 300, 60, ST_COLOR_RED, ST_COLOR_NAVY));
+	MEASURE(st_draw_arc_aa(&display, 120, 140, 30, 45, 315, ST_COLOR_CYAN, ST_COLOR_NAVY));
+	MEASURE(st_draw_circle_aa(&display, 230, 230, 30, ST_COLOR_WHITE, ST_COLOR_NAVY));
+}
+
+
+/*
+ * Triangles, a concave star and an area chart
+ */
+static void _area_chart(void)
+{
+	st_point_t points[62];
+	for (uint8_t i = 0; i < 60; i++)
+	{
+		points[i].x = 10 + i * 220 / 59;
+		points[i].y = 200 - (i * 37 % 53) - (i * i % 29);
+	}
+	points[60] = (st_point_t){230, 230};
+	points[61] = (st_point_t){10, 230};
+	st_fill_polygon(&display, points, 62, ST_COLOR_DARKCYAN);
+}
+
+static void scene_polygons(void)
+{
+	static const st_point_t star[10] =
+	{
+		{180, 10}, {191, 44}, {227, 44}, {198, 65}, {209, 99},
+		{180, 78}, {151, 99}, {162, 65}, {133, 44}, {169, 44},
+	};
+	static const st_point_t beam[4] = {{-400, -30000}, {-392, -30000}, {568, 30000}, {560, 30000}};
+	static const st_point_t wedge[3] = {{-20000, -20000}, {20000, 20010}, {20000, 19990}};
+
+	MEASURE(st_fill_screen(&display, ST_COLOR_BLACK));
+	MEASURE(st_fill_triangle(&display, 10, 10, 110, 30, 40, 100, ST_COLOR_RED));
+	MEASURE(st_fill_triangle(&display, 110, 30, 40, 100, 120, 110, ST_COLOR_YELLOW));
+	MEASURE(st_fill_polygon(&display, star, 10, ST_COLOR_ORANGE));
+	MEASURE(_area_chart());
+	// Vertices far off the screen, edges more than 32767 rows high
+	MEASURE(st_fill_polygon(&display, beam, 4, ST_COLOR_WHITE));
+	MEASURE(st_fill_polygon(&display, wedge, 3, ST_COLOR_MAGENTA));
+}
+
+
+/*
+ * The same widget drawn at its own origin in three clip rectangles, one partly off the screen
+ */
+static void _gauge(void)
+{
+	st_fill_rect(&display, 0, 0, 100, 100, ST_COLOR_DARKGREY);
+	st_fill_ring(&display, 50, 50, 45, 35, ST_COLOR_GREEN);
+	st_fill_triangle(&display, 50, 15, 45, 50, 55, 50, ST_COLOR_RED);
+	st_draw_string(&display, 30, 60, "42", ST_COLOR_WHITE, &font_ubuntu_mono_24);
+}
+
+static void _clipped_gauge(int16_t x, int16_t y, uint16_t w, uint16_t h)
+{
+	st_push_clip(&display, x, y, w, h);
+	st_set_origin(&display, x, y);
+	_gauge();
+	st_pop_clip(&display);
+}
+
+/*
+ * Polygons under a shifted origin, as in a scrolled view. Their rows are clipped in screen coordinates.
+ */
+static void _scrolled_polygon(int16_t dx, int16_t dy, const st_point_t *points, uint16_t n, uint16_t color)
+{
+	st_push_clip(&display, 0, 0, ST_SIM_WIDTH, ST_SIM_HEIGHT);
+	st_set_origin(&display, dx, dy);
+	st_fill_polygon(&display, points, n, color);
+	st_pop_clip(&display);
+}
+
+static void scene_origin(void)
+{
+	static const st_point_t below[3] = {{10, 150}, {100, 300}, {10, 300}};
+	static const st_point_t above[3] = {{130, -60}, {230, -60}, {180, 40}};
+	static const st_point_t star[10] =
+	{
+		{180, 10}, {191, 44}, {227, 44}, {198, 65}, {209, 99},
+		{180, 78}, {151, 99}, {162, 65}, {133, 44}, {169, 44},
+	};
+
+	MEASURE(st_fill_screen(&display, ST_COLOR_BLACK));
+	MEASURE(_scrolled_polygon(0, -100, below, 3, ST_COLOR_RED));
+	MEASURE(_scrolled_polygon(0, 100, above, 3, ST_COLOR_YELLOW));
+	MEASURE(_scrolled_polygon(-120, 170, star, 10, ST_COLOR_CYAN));
+}
+
+static void scene_clip(void)
+{
+	MEASURE(st_fill_screen(&display, ST_COLOR_BLACK));
+	MEASURE(_clipped_gauge(10, 10, 100, 100));
+	MEASURE(_clipped_gauge(130, 10, 100, 50));
+	MEASURE(_clipped_gauge(170, 170, 100, 100));
+}
+
+
+/*
+ * Vertical, horizontal and radial gradients, with and without dithering
+ */
+static void scene_gradients(void)
+{
+	MEASURE(st_fill_gradient_rect(&display, 0, 0, 240, 120, ST_COLOR_NAVY, ST_COLOR_BLACK, ST_GRADIENT_VERTICAL));
+	MEASURE(st_fill_gradient_rect(&display, 0, 120, 240, 120, ST_COLOR_NAVY, ST_COLOR_BLACK, ST_GRADIENT_VERTICAL | ST_GRADIENT_DITHER));
+	MEASURE(st_fill_gradient_rect(&display, 10, 10, 100, 40, ST_COLOR_RED, ST_COLOR_YELLOW, ST_GRADIENT_HORIZONTAL));
+	MEASURE(st_fill_gradient_rect(&display, 130, 10, 100, 40, ST_COLOR_RED, ST_COLOR_YELLOW, ST_GRADIENT_HORIZONTAL | ST_GRADIENT_DITHER));
+	MEASURE(st_fill_gradient_rect(&display, 10, 130, 100, 100, ST_COLOR_WHITE, ST_COLOR_DARKCYAN, ST_GRADIENT_RADIAL));
+	MEASURE(st_fill_gradient_rect(&display, 130, 130, 100, 100, ST_COLOR_WHITE, ST_COLOR_DARKCYAN, ST_GRADIENT_RADIAL | ST_GRADIENT_DITHER));
+}
+
+
+/*
+ * Checkerboard, hatching and a striped progress bar from pattern tiles
+ */
+static void scene_patterns(void)
+{
+	static uint16_t checker[8 * 8];
+	static uint16_t hatch[6 * 6];
+	static uint16_t stripes[12 * 1];
+	for (uint8_t i = 0; i < 8 * 8; i++)
+		checker[i] = ((i / 8 < 4) != (i % 8 < 4)) ? ST_COLOR_LIGHTGREY : ST_COLOR_DARKGREY;
+	for (uint8_t i = 0; i < 6 * 6; i++)
+		hatch[i] = (i / 6 == 5 - i % 6) ? ST_COLOR_YELLOW : ST_COLOR_BLACK;
+	for (uint8_t i = 0; i < 12; i++)
+		stripes[i] = (i < 6) ? ST_COLOR_GREEN : ST_COLOR_DARKGREEN;
+
+	MEASURE(st_fill_pattern_rect(&display, 0, 0, 240, 240, checker, 8, 8));
+	MEASURE(st_fill_pattern_rect(&display, 20, 20, 200, 100, hatch, 6, 6));
+	MEASURE(st_fill_pattern_rect(&display, 20, 150, 150, 30, stripes, 12, 1));
+	MEASURE(st_draw_rectangle(&display, 19, 149, 202, 32, ST_COLOR_WHITE));
+}
+
+
+/*
+ * Rounded cards with gauges: ring segments over a dim full ring, and a 1px arc
+ */
+static void _gauge_card(int16_t x, int16_t y, uint16_t value)
+{
+	st_fill_round_rect(&display, x, y, 110, 110, 12, ST_COLOR_DARKGREY);
+	st_fill_ring(&display, x + 55, y + 55, 45, 35, ST_COLOR_BLACK);
+	st_fill_ring_segment(&display, x + 55, y + 55, 45, 35, 135, 135 + value, ST_COLOR_GREEN);
+	st_draw_arc(&display, x + 55, y + 55, 30, 135, 45, ST_COLOR_WHITE);
+}
+
+static void scene_gauges(void)
+{
+	MEASURE(st_fill_screen(&display, ST_COLOR_NAVY));
+	MEASURE(_gauge_card(5, 5, 200));
+	MEASURE(_gauge_card(125, 5, 60));
+	MEASURE(st_fill_round_rect(&display, 5, 125, 230, 50, 25, ST_COLOR_PURPLE));
+	MEASURE(st_fill_round_rect(&display, 5, 185, 230, 50, 6, ST_COLOR_OLIVE));
+	MEASURE(st_fill_ring_segment(&display, 120, 210, 20, 10, 300, 240, ST_COLOR_ORANGE));
+}
+
+
+/*
+ * A 240-point trace drawn as separate lines and as a polyline, and thick strokes with each join
+ */
+static st_point_t trace[240];
+
+static void _trace_lines(void)
+{
+	for (uint8_t i = 0; i + 1 < 240; i++)
+		st_draw_line(&display, trace[i].x, trace[i].y, trace[i + 1].x, trace[i + 1].y, 1, ST_COLOR_GREEN);
+}
+
+static void _zigzag(int16_t x, uint8_t join, uint16_t color)
+{
+	const st_point_t zigzag[4] = {{x, 200}, {x + 20, 130}, {x + 50, 190}, {x + 65, 150}};
+	st_draw_polyline(&display, zigzag, 4, 9, join, color);
+}
+
+static void _frame_path(void)
+{
+	st_point_t buffer[10];
+	st_path_t path;
+	st_path_init(&path, buffer, 10);
+	st_path_move_to(&path, 10, 10);
+	st_path_line_to(&path, 229, 10);
+	st_path_line_to(&path, 229, 229);
+	st_path_line_to(&path, 10, 229);
+	st_path_close(&path);
+	st_path_move_to(&path, 20, 110);
+	st_path_line_to(&path, 220, 110);
+	st_draw_path(&display, &path, 3, ST_JOIN_MITER, ST_COLOR_WHITE);
+}
+
+/*
+ * Lines between points far off the screen, longer than 32767
+ */
+static void _long_lines(void)
+{
+	static const st_point_t edge[2] = {{4, -30000}, {4, 30000}};
+	static const st_point_t slope[2] = {{-17880, -11880}, {18120, 12120}};
+	static const st_point_t cross[2] = {{16640, -16400}, {-16400, 16640}};
+	st_draw_polyline(&display, edge, 2, 1, ST_JOIN_MITER, ST_COLOR_WHITE);
+	st_draw_polyline(&display, slope, 2, 1, ST_JOIN_MITER, ST_COLOR_WHITE);
+	st_draw_polyline(&display, cross, 2, 5, ST_JOIN_MITER, ST_COLOR_MAGENTA);
+}
+
+static void scene_paths(void)
+{
+	for (uint8_t i = 0; i < 240; i++)
+	{
+		int16_t tri = (i % 60 < 30) ? (i % 60) : (60 - i % 60);
+		trace[i] = (st_point_t){i, 30 + 2 * tri + (i * 37) % 7};
+	}
+
+	MEASURE(st_fill_screen(&display, ST_COLOR_BLACK));
+	MEASURE(_trace_lines());
+	MEASURE(st_fill_screen(&display, ST_COLOR_BLACK));
+	MEASURE(st_draw_polyline(&display, trace, 240, 1, ST_JOIN_MITER, ST_COLOR_GREEN));
+	MEASURE(_zigzag(20, ST_JOIN_MITER, ST_COLOR_RED));
+	MEASURE(_zigzag(90, ST_JOIN_BEVEL, ST_COLOR_YELLOW));
+	MEASURE(_zigzag(160, ST_JOIN_ROUND, ST_COLOR_CYAN));
+	MEASURE(_frame_path());
+	MEASURE(_long_lines());
+}
+
+
+/*
+ * A smooth chart curve through data points, a thick arch and a heart from cubic curves
+ */
+static void _chart_curve(void)
+{
+	static const int16_t values[7] = {70, 40, 50, 20, 35, 15, 30};
+	for (uint8_t i = 0; i + 1 < 7; i++)
+	{
+		int16_t x = 20 + i * 35;
+		st_draw_bezier3(&display, x, values[i], x + 17, values[i], x + 18, values[i + 1], x + 35, values[i + 1], 1, ST_COLOR_GREEN);
+	}
+}
+
+static void _heart(int16_t x, int16_t y)
+{
+	st_draw_bezier3(&display, x, y + 60, x - 60, y + 10, x - 25, y - 35, x, y - 5, 3, ST_COLOR_RED);
+	st_draw_bezier3(&display, x, y - 5, x + 25, y - 35, x + 60, y + 10, x, y + 60, 3, ST_COLOR_RED);
+}
+
+static void scene_curves(void)
+{
+	MEASURE(st_fill_screen(&display, ST_COLOR_BLACK));
+	MEASURE(_chart_curve());
+	MEASURE(st_draw_bezier2(&display, 20, 230, 120, 110, 220, 230, 7, ST_COLOR_ORANGE));
+	MEASURE(_heart(120, 105));
+}
+
+
+
+/*
+ * Map zones filled with pixels read back from the panel, and icons filled with a shadow
+ */
+static void _map(void)
+{
+	st_draw_rectangle(&display, 10, 10, 220, 100, ST_COLOR_WHITE);
+	st_draw_bezier3(&display, 90, 10, 60, 50, 140, 70, 110, 109, 1, ST_COLOR_WHITE);
+	st_draw_line(&display, 10, 80, 230, 40, 1, ST_COLOR_WHITE);
+	st_draw_circle(&display, 180, 75, 20, ST_COLOR_WHITE);
+}
+
+static void _icons(void)
+{
+	static const st_point_t star[10] =
+	{
+		{180, 130}, {191, 164}, {227, 164}, {198, 185}, {209, 219},
+		{180, 198}, {151, 219}, {162, 185}, {133, 164}, {169, 164},
+	};
+	st_draw_bezier3(&display, 60, 225, 0, 175, 35, 130, 60, 160, 2, ST_COLOR_WHITE);
+	st_draw_bezier3(&display, 60, 160, 85, 130, 120, 175, 60, 225, 2, ST_COLOR_WHITE);
+	st_draw_polyline(&display, star, 10, 1, ST_JOIN_MITER, ST_COLOR_WHITE);
+	st_draw_line(&display, 169, 164, 180, 130, 1, ST_COLOR_WHITE);
+}
+
+static void scene_flood(void)
+{
+	static uint8_t shadow[ST_SIM_WIDTH * ST_SIM_HEIGHT / 4];
+	static const uint16_t colors[3] = {ST_COLOR_WHITE, ST_COLOR_RED, ST_COLOR_YELLOW};
+
+	// Only CS high ends reading the panel
+	display.cs = GPIO1;
+	st_sim_attach_cs(0, GPIO1);
+	st_init(&display);
+
+	MEASURE(st_fill_screen(&display, ST_COLOR_BLACK));
+	MEASURE(_map());
+	MEASURE(st_flood_fill(&display, 30, 30, ST_COLOR_DARKGREEN));
+	MEASURE(st_flood_fill(&display, 150, 30, ST_COLOR_OLIVE));
+	MEASURE(st_flood_fill(&display, 30, 100, ST_COLOR_DARKCYAN));
+	MEASURE(st_flood_fill(&display, 220, 100, ST_COLOR_PURPLE));
+	MEASURE(st_flood_fill(&display, 180, 75, ST_COLOR_BLUE));
+
+	MEASURE(st_set_shadow(&display, shadow, 2, colors));
+	MEASURE(_icons());
+	MEASURE(st_flood_fill(&display, 60, 190, ST_COLOR_RED));
+	MEASURE(st_flood_fill(&display, 180, 180, ST_COLOR_YELLOW));
+	st_set_shadow(&display, NULL, 2, colors);
+	display.cs = 0;
+}
+
+
+/*
+ * A clock ticking with text with background. Digits after the first second come from the glyph cache.
+ */
+static void scene_clock(void)
+{
+	static uint16_t cache[4000];
+	char time[] = "12:34:56";
+
+	MEASURE(st_fill_screen(&display, ST_COLOR_NAVY));
+	MEASURE(st_set_glyph_cache(&display, cache, sizeof(cache) / sizeof(cache[0])));
+	MEASURE(st_draw_string_withbg(&display, 60, 100, time, ST_COLOR_WHITE, ST_COLOR_NAVY, &font_ubuntu_mono_24));
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		time[7]++;
+		MEASURE(st_draw_string_withbg(&display, 60, 100, time, ST_COLOR_WHITE, ST_COLOR_NAVY, &font_ubuntu_mono_24));
+	}
+	MEASURE(st_draw_string_withbg(&display, 60, 140, "12:35:00", ST_COLOR_YELLOW, ST_COLOR_NAVY, &font_ubuntu_mono_24));
+
+	st_glyph_cache_stats_t stats = st_get_glyph_cache_stats(&display);
+	printf("  glyph cache: %u hits, %u misses, %u evictions\n", stats.hits, stats.misses, stats.evictions);
+	st_set_glyph_cache(&display, NULL, 0);
+}
+
+typedef struct
+{
+	const char *name;
+	void (*draw)(void);
+	uint32_t golden;		// FNV-1a hash of the expected frame (see st_sim_frame_hash())
+} scene_t;
+
+static const scene_t scenes[] =
+{
+	{"example",		scene_example,		0x9f3aacdc},
+	{"bitmap",		scene_bitmap,		0x7bd199de},
+	{"dashboard",	scene_dashboard,	0x7c9655d9},
+	{"shapes",		scene_shapes,		0x794accf0},
+	{"polygons",	scene_polygons,		0x897d661c},
+	{"clip",		scene_clip,			0xc01c51a6},
+	{"origin",		scene_origin,		0x0300acbf},
+	{"gradients",	scene_gradients,	0x6a10d954},
+	{"patterns",	scene_patterns,		0x702ab0f1},
+	{"gauges",		scene_gauges,		0x0765d2f1},
+	{"paths",		scene_paths,		0xdb26717e},
+	{"curves",		scene_curves,		0xa1277b46},
+	{"flood",		scene_flood,		0x224df717},
+	{"clock",		scene_clock,		0x69dc3574},
+};
+
+
+int main(void)
+{
+	int failed = 0;
+
+	for (uint8_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++)
+	{
+		char path[256];
+
+		st_sim_reset();
+		st_init(&display);
+
+		printf("%s\n", scenes[i].name);
+		printf("  %-60s %8s %6s %6s %6s %6s %4s %4s\n", "call", "bytes", "cmds", "caset", "raset", "ramwr", "dma", "irqs");
+		scenes[i].draw();
+
+		uint32_t hash = st_sim_frame_hash(0);
+		snprintf(path, sizeof(path), "%s/%s.ppm", ST_SIM_OUT_DIR, scenes[i].name);
+		st_sim_write_ppm(0, path);
+
+		if (hash == scenes[i].golden)
+		{
+			printf("  frame %08x OK\n\n", hash);
+		}
+		else
+		{
+			printf("  frame %08x DIFFERS from golden %08x, see %s\n\n", hash, scenes[i].golden, path);
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
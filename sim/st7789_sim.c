@@ -0,0 +1,716 @@
+/*
+MIT License
+
+Copyright (c) 2020 Avra Mitra
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/dwt.h>
+#include "st7789_sim.h"
+
+// Peripheral address space covered by the register file (APB1, APB2, AHB DMA)
+#define ST_SIM_PERIPH_BASE		0x40000000u
+#define ST_SIM_PERIPH_SIZE		0x00021000u
+// Core cycle counter (DWT_CYCCNT)
+#define ST_SIM_DWT_CYCCNT		(DWT_BASE + 0x04)
+// SPI_DR holds this value when there's nothing left to clock out
+#define ST_SIM_DR_EMPTY			((uintptr_t)-1)
+
+#define ST_SIM_CASET		0x2A
+#define ST_SIM_RASET		0x2B
+#define ST_SIM_RAMWR		0x2C
+#define ST_SIM_RAMRD		0x2E
+#define ST_SIM_MADCTL		0x36
+#define ST_SIM_COLMOD		0x3A
+#define ST_SIM_SWRESET		0x01
+// COLMOD after reset: 262K colors, 18-bit (3 bytes per pixel)
+#define ST_SIM_COLMOD_RESET	0x66
+#define ST_SIM_COLMOD_16BIT	0x05
+
+#define ST_SIM_MADCTL_MY	0x80
+#define ST_SIM_MADCTL_MX	0x40
+#define ST_SIM_MADCTL_MV	0x20
+
+typedef struct
+{
+	uint32_t spi;
+	uint32_t dc_port;
+	uint16_t dc_pin;
+	uint16_t cs_pin;			// on the D/C port, 0 if the panel is always selected
+
+	// controller state
+	uint8_t cmd;
+	uint8_t param_idx;
+	uint8_t params[4];
+	uint8_t madctl;
+	uint8_t colmod;
+	uint16_t xs, xe, ys, ye;
+	uint16_t cur_x, cur_y;
+	uint8_t n_pixel_bytes;		// bytes of the current pixel received so far
+	uint8_t pixel_bytes[3];
+	// RAMRD: pixels are read out as 3 bytes (6 bits per color at the top), after one dummy bit
+	uint8_t reading;
+	uint16_t rd_x, rd_y;
+	uint32_t rd_bits;			// bits ready to be clocked out, the oldest at the top
+	uint8_t rd_n_bits;
+	uint8_t rx_mode;			// 1: SPI is turned around to receive from the panel, 2: and a byte was received
+
+	uint16_t gram[ST_SIM_HEIGHT][ST_SIM_WIDTH];
+	st_sim_stats_t stats;
+} st_sim_panel_t;
+
+static uintptr_t st_sim_regs[ST_SIM_PERIPH_SIZE / 4];
+static uintptr_t st_sim_dummy_reg;
+static uintptr_t st_sim_cycles;			// DWT_CYCCNT, see st_sim_reg()
+static uintptr_t *st_sim_last_reg;		// register accessed last, to see when SPI_DR was read
+static st_sim_panel_t st_sim_panels[ST_SIM_PANELS];
+
+static uint8_t st_sim_irq_enabled[64];
+static uint8_t st_sim_irq_pending[64];
+static uint8_t st_sim_in_isr = 0;
+
+// Interrupt handlers of the DMA1 channels, defined by the driver (or the application)
+void dma1_channel3_isr(void) __attribute__((weak));
+void dma1_channel5_isr(void) __attribute__((weak));
+
+
+static uintptr_t *_st_sim_slot(uintptr_t addr)
+{
+	if (addr >= ST_SIM_PERIPH_BASE && addr < ST_SIM_PERIPH_BASE + ST_SIM_PERIPH_SIZE)
+		return &st_sim_regs[(addr - ST_SIM_PERIPH_BASE) / 4];
+	return &st_sim_dummy_reg;
+}
+
+// Inside the simulator registers are accessed directly, without syncing
+#undef MMIO16
+#undef MMIO32
+#define MMIO16(addr)		(*_st_sim_slot((uintptr_t)(addr)))
+#define MMIO32(addr)		(*_st_sim_slot((uintptr_t)(addr)))
+
+
+static void _st_sim_map(const st_sim_panel_t *p, uint16_t x, uint16_t y, uint16_t *col, uint16_t *row)
+{
+	*col = x;
+	*row = y;
+	if (p->madctl & ST_SIM_MADCTL_MV)
+	{
+		*col = y;
+		*row = x;
+	}
+	if (p->madctl & ST_SIM_MADCTL_MX)
+		*col = ST_SIM_WIDTH - 1 - *col;
+	if (p->madctl & ST_SIM_MADCTL_MY)
+		*row = ST_SIM_HEIGHT - 1 - *row;
+}
+
+static void _st_sim_plot(st_sim_panel_t *p, uint16_t x, uint16_t y, uint16_t color)
+{
+	uint16_t col, row;
+	_st_sim_map(p, x, y, &col, &row);
+
+	p->stats.pixels++;
+	// Pixels outside the visible area are discarded by the panel
+	if (col < ST_SIM_WIDTH && row < ST_SIM_HEIGHT)
+		p->gram[row][col] = color;
+}
+
+
+/*
+ * Move a memory pointer to the next pixel. Column address moves first, then row address.
+ * Both wrap inside the window.
+ */
+static void _st_sim_advance(const st_sim_panel_t *p, uint16_t *x, uint16_t *y)
+{
+	if (*x >= p->xe)
+	{
+		*x = p->xs;
+		*y = (*y >= p->ye) ? p->ys : *y + 1;
+	}
+	else
+	{
+		(*x)++;
+	}
+}
+
+
+/*
+ * Next byte clocked out by the panel while it's read
+ */
+static uint8_t _st_sim_read_byte(st_sim_panel_t *p)
+{
+	// Nothing drives the line
+	if (!p->reading)
+		return 0xFF;
+
+	if (p->rd_n_bits < 8)
+	{
+		uint16_t col, row, color = 0;
+		_st_sim_map(p, p->rd_x, p->rd_y, &col, &row);
+		if (col < ST_SIM_WIDTH && row < ST_SIM_HEIGHT)
+			color = p->gram[row][col];
+		_st_sim_advance(p, &p->rd_x, &p->rd_y);
+
+		// RGB565 is widened to 6 bits per color
+		uint8_t r = (uint8_t)((color >> 11) << 1 | (color >> 15));
+		uint8_t g = (uint8_t)((color >> 5) & 0x3F);
+		uint8_t b = (uint8_t)((color & 0x1F) << 1 | ((color >> 4) & 1));
+		p->rd_bits = (p->rd_bits << 24) | ((uint32_t)r << 18) | ((uint32_t)g << 10) | ((uint32_t)b << 2);
+		p->rd_n_bits += 24;
+	}
+
+	p->rd_n_bits -= 8;
+	p->stats.read_bytes++;
+	return (uint8_t)(p->rd_bits >> p->rd_n_bits);
+}
+
+
+/*
+ * A byte arrived at the panel
+ */
+static void _st_sim_panel_byte(st_sim_panel_t *p, uint8_t b, uint8_t dc)
+{
+	p->stats.bytes++;
+	if (!dc)
+	{
+		p->stats.cmd_bytes++;
+		p->cmd = b;
+		p->param_idx = 0;
+		p->n_pixel_bytes = 0;
+		p->reading = 0;
+		switch (b)
+		{
+			case ST_SIM_RAMRD:
+				p->reading = 1;
+				p->rd_x = p->xs;
+				p->rd_y = p->ys;
+				p->rd_bits = 0;
+				p->rd_n_bits = 1;	// dummy bit
+				break;
+			case ST_SIM_CASET:		p->stats.caset++;	break;
+			case ST_SIM_RASET:		p->stats.raset++;	break;
+			case ST_SIM_MADCTL:		p->stats.madctl++;	break;
+			case ST_SIM_COLMOD:		p->stats.colmod++;	break;
+			case ST_SIM_RAMWR:
+				p->stats.ramwr++;
+				p->cur_x = p->xs;
+				p->cur_y = p->ys;
+				break;
+			case ST_SIM_SWRESET:
+				p->madctl = 0;
+				p->colmod = ST_SIM_COLMOD_RESET;
+				break;
+		}
+		return;
+	}
+
+	p->stats.data_bytes++;
+	switch (p->cmd)
+	{
+		case ST_SIM_CASET:
+		case ST_SIM_RASET:
+			if (p->param_idx < 4)
+				p->params[p->param_idx++] = b;
+			if (p->param_idx == 4)
+			{
+				uint16_t start = (uint16_t)(p->params[0] << 8) | p->params[1];
+				uint16_t end = (uint16_t)(p->params[2] << 8) | p->params[3];
+				if (p->cmd == ST_SIM_CASET)
+				{
+					p->xs = start;
+					p->xe = end;
+				}
+				else
+				{
+					p->ys = start;
+					p->ye = end;
+				}
+			}
+			break;
+
+		case ST_SIM_MADCTL:
+			p->madctl = b;
+			break;
+
+		case ST_SIM_COLMOD:
+			p->colmod = b;
+			break;
+
+		case ST_SIM_RAMWR:
+		{
+			// 16-bit: RGB565 in 2 bytes. Otherwise 18-bit: 6 bits per color in the top of 3 bytes.
+			uint8_t is_16bit = (p->colmod & 0x07) == ST_SIM_COLMOD_16BIT;
+			p->pixel_bytes[p->n_pixel_bytes++] = b;
+			if (p->n_pixel_bytes < (is_16bit ? 2 : 3))
+				break;
+			p->n_pixel_bytes = 0;
+
+			uint16_t color;
+			if (is_16bit)
+				color = (uint16_t)(p->pixel_bytes[0] << 8) | p->pixel_bytes[1];
+			else
+				color = (uint16_t)((p->pixel_bytes[0] >> 3) << 11) | (uint16_t)((p->pixel_bytes[1] >> 2) << 5) | (p->pixel_bytes[2] >> 3);
+			_st_sim_plot(p, p->cur_x, p->cur_y, color);
+			_st_sim_advance(p, &p->cur_x, &p->cur_y);
+			break;
+		}
+	}
+}
+
+
+/*
+ * A frame was written to SPI_DR of `spi`
+ */
+static void _st_sim_spi_frame(uint32_t spi, uint16_t frame)
+{
+	for (uint8_t i = 0; i < ST_SIM_PANELS; i++)
+	{
+		st_sim_panel_t *p = &st_sim_panels[i];
+		if (p->spi != spi || (GPIO_ODR(p->dc_port) & p->cs_pin))
+			continue;
+		// After RAMRD the panel drives SDA until CS goes high, so whatever is sent is lost
+		if (p->reading)
+		{
+			p->stats.lost_bytes += (SPI_CR1(spi) & SPI_CR1_DFF) ? 2 : 1;
+			continue;
+		}
+		uint8_t dc = (GPIO_ODR(p->dc_port) & p->dc_pin) ? 1 : 0;
+		if (SPI_CR1(spi) & SPI_CR1_DFF)
+			_st_sim_panel_byte(p, (uint8_t)(frame >> 8), dc);
+		_st_sim_panel_byte(p, (uint8_t)frame, dc);
+	}
+}
+
+
+static st_sim_panel_t *_st_sim_panel_of(uint32_t spi)
+{
+	for (uint8_t i = 0; i < ST_SIM_PANELS; i++)
+		if (st_sim_panels[i].spi == spi)
+			return &st_sim_panels[i];
+	return NULL;
+}
+
+
+static void _st_sim_gpio(uint32_t port)
+{
+	uintptr_t *odr = &GPIO_ODR(port);
+	uintptr_t *bsrr = &GPIO_BSRR(port);
+	uintptr_t *brr = &GPIO_BRR(port);
+	if (*bsrr)
+	{
+		*odr |= *bsrr & 0xFFFF;
+		*odr &= ~(*bsrr >> 16);
+		*bsrr = 0;
+	}
+	if (*brr)
+	{
+		*odr &= ~(*brr & 0xFFFF);
+		*brr = 0;
+	}
+
+	// CS high ends a read
+	for (uint8_t i = 0; i < ST_SIM_PANELS; i++)
+	{
+		st_sim_panel_t *p = &st_sim_panels[i];
+		if (p->spi && p->dc_port == port && (*odr & p->cs_pin))
+			p->reading = 0;
+	}
+}
+
+
+static void _st_sim_spi(uint32_t spi)
+{
+	uintptr_t *dr = &SPI_DR(spi);
+	uintptr_t cr1 = SPI_CR1(spi);
+	st_sim_panel_t *p = _st_sim_panel_of(spi);
+
+	// Bidirectional mode with the output disabled: the master clocks bytes in as long as SPI is
+	// enabled. A new byte is ready as soon as the last one was read from SPI_DR.
+	if ((cr1 & SPI_CR1_BIDIMODE) && !(cr1 & SPI_CR1_BIDIOE))
+	{
+		if (p && !p->rx_mode)
+			p->rx_mode = 1;
+		if ((cr1 & SPI_CR1_SPE) && p && (p->rx_mode == 1 || st_sim_last_reg == dr))
+		{
+			*dr = _st_sim_read_byte(p);
+			SPI_SR(spi) = SPI_SR_TXE | SPI_SR_RXNE;
+			p->rx_mode = 2;
+		}
+		return;
+	}
+	if (p && p->rx_mode)
+	{
+		// Back to transmitting. The last received byte is not sent.
+		p->rx_mode = 0;
+		*dr = ST_SIM_DR_EMPTY;
+	}
+
+	if (*dr != ST_SIM_DR_EMPTY)
+	{
+		_st_sim_spi_frame(spi, (uint16_t)*dr);
+		*dr = ST_SIM_DR_EMPTY;
+	}
+	// Transfers are instant
+	SPI_SR(spi) = SPI_SR_TXE;
+}
+
+
+/*
+ * Run an enabled DMA1 channel that feeds `spi` to completion.
+ * A circular channel runs one round at a time. The next round starts once the interrupt flag
+ * of the last one is cleared, as if the interrupt was always taken right away.
+ */
+static void _st_sim_dma(uint8_t channel, uint32_t spi)
+{
+	uintptr_t *ccr = &DMA_CCR(DMA1, channel);
+	uintptr_t *cndtr = &DMA_CNDTR(DMA1, channel);
+	uint8_t circular = (*ccr & DMA_CCR_CIRC) ? 1 : 0;
+
+	if (!(*ccr & DMA_CCR_EN) || !(SPI_CR2(spi) & SPI_CR2_TXDMAEN) || *cndtr == 0)
+		return;
+	if (circular && (DMA_ISR(DMA1) & (DMA_TCIF << ((channel - 1) * 4))))
+		return;
+
+	st_sim_panel_t *p = _st_sim_panel_of(spi);
+	if (p)
+		p->stats.dma_transfers++;
+
+	uintptr_t src = DMA_CMAR(DMA1, channel);
+	uint8_t msize16 = (*ccr & DMA_CCR_MSIZE_MASK) == DMA_CCR_MSIZE_16BIT;
+	uint8_t psize16 = (*ccr & DMA_CCR_PSIZE_MASK) == DMA_CCR_PSIZE_16BIT;
+	uint32_t count = (uint32_t)*cndtr;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint16_t unit = msize16 ? *(const uint16_t *)src : *(const uint8_t *)src;
+		if (!psize16)
+			unit &= 0xFF;
+		_st_sim_spi_frame(spi, unit);
+		if (*ccr & DMA_CCR_MINC)
+			src += msize16 ? 2 : 1;
+	}
+
+	// Circular channel reloads the count
+	if (!circular)
+		*cndtr = 0;
+	DMA_ISR(DMA1) |= (DMA_TCIF | DMA_GIF) << ((channel - 1) * 4);
+	if (*ccr & DMA_CCR_TCIE)
+		st_sim_irq_pending[NVIC_DMA1_CHANNEL3_IRQ - 3 + channel] = 1;
+}
+
+
+static void _st_sim_process(void);
+
+static void _st_sim_deliver_irqs(void)
+{
+	if (st_sim_in_isr)
+		return;
+
+	uint8_t taken;
+	do
+	{
+		taken = 0;
+		for (uint8_t irq = 0; irq < 64; irq++)
+		{
+			if (!st_sim_irq_pending[irq] || !st_sim_irq_enabled[irq])
+				continue;
+			st_sim_irq_pending[irq] = 0;
+
+			void (*handler)(void) = NULL;
+			st_sim_panel_t *p = NULL;
+			if (irq == NVIC_DMA1_CHANNEL3_IRQ)
+			{
+				handler = dma1_channel3_isr;
+				p = _st_sim_panel_of(SPI1);
+			}
+			else if (irq == NVIC_DMA1_CHANNEL5_IRQ)
+			{
+				handler = dma1_channel5_isr;
+				p = _st_sim_panel_of(SPI2);
+			}
+			if (!handler)
+				continue;
+
+			if (p)
+				p->stats.irqs++;
+			st_sim_in_isr = 1;
+			handler();
+			st_sim_in_isr = 0;
+			// Hardware keeps going after the handler returns, even if the
+			// application is only spinning on a flag
+			_st_sim_process();
+			taken = 1;
+		}
+	} while (taken);
+}
+
+
+/*
+ * Handle everything the last register access did
+ */
+static void _st_sim_process(void)
+{
+	_st_sim_gpio(GPIOA);
+	_st_sim_gpio(GPIOB);
+	_st_sim_gpio(GPIOC);
+
+	uintptr_t *ifcr = &DMA_IFCR(DMA1);
+	if (*ifcr)
+	{
+		// Clearing the global flag of a channel clears all of its flags
+		for (uint8_t ch = 0; ch < 7; ch++)
+		{
+			if (*ifcr & (DMA_GIF << (ch * 4)))
+				*ifcr |= DMA_FLAGS << (ch * 4);
+		}
+		DMA_ISR(DMA1) &= ~*ifcr;
+		*ifcr = 0;
+	}
+
+	_st_sim_spi(SPI1);
+	_st_sim_spi(SPI2);
+	_st_sim_dma(3, SPI1);
+	_st_sim_dma(5, SPI2);
+}
+
+
+static void _st_sim_sync(void)
+{
+	_st_sim_process();
+	_st_sim_deliver_irqs();
+}
+
+
+volatile uintptr_t *st_sim_reg(uintptr_t addr)
+{
+	_st_sim_sync();
+	// Time passes only while the core cycle counter is polled: 1 us per read
+	if (addr == ST_SIM_DWT_CYCCNT)
+	{
+		st_sim_cycles += rcc_ahb_frequency / 1000000;
+		return &st_sim_cycles;
+	}
+	st_sim_last_reg = _st_sim_slot(addr);
+	return st_sim_last_reg;
+}
+
+
+void st_sim_reset(void)
+{
+	memset(st_sim_regs, 0, sizeof(st_sim_regs));
+	memset(st_sim_panels, 0, sizeof(st_sim_panels));
+	memset(st_sim_irq_enabled, 0, sizeof(st_sim_irq_enabled));
+	memset(st_sim_irq_pending, 0, sizeof(st_sim_irq_pending));
+	SPI_DR(SPI1) = ST_SIM_DR_EMPTY;
+	SPI_DR(SPI2) = ST_SIM_DR_EMPTY;
+	st_sim_attach(0, SPI1, GPIOA, GPIO2);
+	st_sim_attach(1, SPI2, GPIOB, GPIO12);
+}
+
+
+void st_sim_attach(uint8_t panel, uint32_t spi, uint32_t dc_port, uint16_t dc_pin)
+{
+	if (panel >= ST_SIM_PANELS)
+		return;
+	st_sim_panels[panel].spi = spi;
+	st_sim_panels[panel].colmod = ST_SIM_COLMOD_RESET;
+	st_sim_panels[panel].dc_port = dc_port;
+	st_sim_panels[panel].dc_pin = dc_pin;
+}
+
+
+void st_sim_attach_cs(uint8_t panel, uint16_t cs_pin)
+{
+	if (panel < ST_SIM_PANELS)
+		st_sim_panels[panel].cs_pin = cs_pin;
+}
+
+
+st_sim_stats_t st_sim_get_stats(uint8_t panel)
+{
+	_st_sim_sync();
+	return st_sim_panels[panel % ST_SIM_PANELS].stats;
+}
+
+
+void st_sim_reset_stats(void)
+{
+	_st_sim_sync();
+	for (uint8_t i = 0; i < ST_SIM_PANELS; i++)
+		memset(&st_sim_panels[i].stats, 0, sizeof(st_sim_stats_t));
+}
+
+
+uint16_t st_sim_get_pixel(uint8_t panel, uint16_t x, uint16_t y)
+{
+	_st_sim_sync();
+	if (x >= ST_SIM_WIDTH || y >= ST_SIM_HEIGHT)
+		return 0;
+	return st_sim_panels[panel % ST_SIM_PANELS].gram[y][x];
+}
+
+
+uint32_t st_sim_frame_hash(uint8_t panel)
+{
+	_st_sim_sync();
+	uint32_t hash = 2166136261u;
+	const uint8_t *bytes = (const uint8_t *)st_sim_panels[panel % ST_SIM_PANELS].gram;
+	for (uint32_t i = 0; i < sizeof(st_sim_panels[0].gram); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+int st_sim_write_ppm(uint8_t panel, const char *path)
+{
+	_st_sim_sync();
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return -1;
+	fprintf(f, "P6\n%d %d\n255\n", ST_SIM_WIDTH, ST_SIM_HEIGHT);
+	for (uint16_t y = 0; y < ST_SIM_HEIGHT; y++)
+	{
+		for (uint16_t x = 0; x < ST_SIM_WIDTH; x++)
+		{
+			uint16_t c = st_sim_panels[panel % ST_SIM_PANELS].gram[y][x];
+			uint8_t rgb[3];
+			rgb[0] = (uint8_t)(((c >> 11) & 0x1F) * 255 / 31);
+			rgb[1] = (uint8_t)(((c >> 5) & 0x3F) * 255 / 63);
+			rgb[2] = (uint8_t)((c & 0x1F) * 255 / 31);
+			fwrite(rgb, 1, 3, f);
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+
+/*
+ * libopencm3 functions used by the driver. They only touch the simulated registers.
+ */
+
+uint32_t rcc_ahb_frequency = 72000000;
+uint32_t rcc_apb1_frequency = 36000000;
+uint32_t rcc_apb2_frequency = 72000000;
+
+void rcc_periph_clock_enable(enum rcc_periph_clken clken)
+{
+	(void)clken;
+}
+
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios)
+{
+	(void)gpioport; (void)mode; (void)cnf; (void)gpios;
+}
+
+void gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+	_st_sim_sync();
+	GPIO_BSRR(gpioport) = gpios;
+}
+
+void gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+	_st_sim_sync();
+	GPIO_BRR(gpioport) = gpios;
+}
+
+void spi_reset(uint32_t spi_peripheral)
+{
+	_st_sim_sync();
+	SPI_CR1(spi_peripheral) = 0;
+	SPI_CR2(spi_peripheral) = 0;
+}
+
+int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol, uint32_t cpha, uint32_t dff, uint32_t lsbfirst)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) = (SPI_CR1(spi) & SPI_CR1_SPE) | SPI_CR1_MSTR | br | cpol | cpha | dff | lsbfirst;
+	return 0;
+}
+
+void spi_enable(uint32_t spi)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) |= SPI_CR1_SPE;
+}
+
+void spi_disable(uint32_t spi)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) &= ~SPI_CR1_SPE;
+}
+
+void spi_enable_software_slave_management(uint32_t spi)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) |= SPI_CR1_SSM;
+}
+
+void spi_set_full_duplex_mode(uint32_t spi)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) &= ~SPI_CR1_BIDIMODE;
+}
+
+void spi_set_bidirectional_transmit_only_mode(uint32_t spi)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) |= SPI_CR1_BIDIMODE | SPI_CR1_BIDIOE;
+}
+
+void spi_set_nss_high(uint32_t spi)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) |= SPI_CR1_SSI;
+}
+
+void spi_set_dff_8bit(uint32_t spi)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) &= ~SPI_CR1_DFF;
+}
+
+void spi_set_dff_16bit(uint32_t spi)
+{
+	_st_sim_sync();
+	SPI_CR1(spi) |= SPI_CR1_DFF;
+}
+
+void nvic_enable_irq(uint8_t irqn)
+{
+	st_sim_irq_enabled[irqn % 64] = 1;
+	_st_sim_sync();
+}
+
+void nvic_disable_irq(uint8_t irqn)
+{
+	_st_sim_sync();
+	st_sim_irq_enabled[irqn % 64] = 0;
+}
@@ -0,0 +1,113 @@
+/*
+MIT License
+
+Copyright (c) 2020 Avra Mitra
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Register level stand-in for STM32F1 SPI, DMA, GPIO and NVIC, with an emulated
+ * ST7789 panel on the other side of the SPI bus. Used to build the display driver
+ * on a Linux host (see sim/Makefile).
+ *
+ * Every MMIO16()/MMIO32() access of the driver goes through st_sim_reg(). Before returning
+ * the register, the simulator handles whatever the previous access did: a byte
+ * written to SPI_DR is clocked out with the current D/C level, a GPIO_BSRR/BRR write
+ * changes the pins, an enabled DMA channel runs to completion and raises its
+ * interrupt. Transfers are instant, so TXE is always set and BSY is always clear.
+ * The core cycle counter (DWT_CYCCNT) moves 1 us at `rcc_ahb_frequency` every time it's read.
+ *
+ * The panel decodes CASET, RASET, RAMWR, RAMRD, MADCTL (MX, MY, MV), COLMOD (16 and 18-bit)
+ * and SWRESET into a 240x240 RGB565 GRAM. Other commands are counted as bytes only.
+ */
+
+#ifndef ST7789_SIM_H_
+#define ST7789_SIM_H_
+
+#include <stdint.h>
+
+// Emulated panel resolution
+#define ST_SIM_WIDTH		240
+#define ST_SIM_HEIGHT		240
+// Max number of panels (one per SPI peripheral)
+#define ST_SIM_PANELS		2
+
+typedef struct
+{
+	uint32_t bytes;				// total bytes clocked out on the bus
+	uint32_t cmd_bytes;			// bytes sent with D/C low
+	uint32_t data_bytes;		// bytes sent with D/C high
+	uint32_t pixels;			// pixels written to GRAM by RAMWR
+	uint32_t read_bytes;		// bytes clocked in from the panel (RAMRD)
+	uint32_t lost_bytes;		// bytes sent while the panel was still driving SDA after RAMRD
+	uint32_t caset;				// number of CASET commands
+	uint32_t raset;				// number of RASET commands
+	uint32_t ramwr;				// number of RAMWR commands
+	uint32_t madctl;			// number of MADCTL commands
+	uint32_t colmod;			// number of COLMOD commands
+	uint32_t dma_transfers;		// number of DMA transfers started
+	uint32_t irqs;				// number of DMA interrupts taken
+} st_sim_stats_t;
+
+/*
+ * Simulated register access. Used by MMIO16() and MMIO32() in the host build.
+ */
+volatile uintptr_t *st_sim_reg(uintptr_t addr);
+
+/*
+ * Reset all registers, panels and statistics.
+ * Panel 0 is connected to SPI1 with D/C on PA2 and panel 1 to SPI2 with D/C on PB12.
+ */
+void st_sim_reset(void);
+
+/*
+ * Connect panel `panel` to `spi` with D/C on `dc_port`/`dc_pin`.
+ */
+void st_sim_attach(uint8_t panel, uint32_t spi, uint32_t dc_port, uint16_t dc_pin);
+
+/*
+ * Connect the CS of `panel` to `cs_pin` of its D/C port. Bytes sent while CS is high are ignored,
+ * and CS high ends a RAMRD. Without it, the panel is always selected and a RAMRD never ends.
+ */
+void st_sim_attach_cs(uint8_t panel, uint16_t cs_pin);
+
+/*
+ * Statistics of `panel` since the last st_sim_reset_stats()
+ */
+st_sim_stats_t st_sim_get_stats(uint8_t panel);
+void st_sim_reset_stats(void);
+
+/*
+ * Read back a pixel of the emulated GRAM in panel (physical) coordinates
+ */
+uint16_t st_sim_get_pixel(uint8_t panel, uint16_t x, uint16_t y);
+
+/*
+ * FNV-1a hash of the GRAM of `panel`. Used to compare frames against golden values.
+ */
+uint32_t st_sim_frame_hash(uint8_t panel);
+
+/*
+ * Dump the GRAM of `panel` as a binary PPM image
+ * @return 0 on success, -1 if the file can't be written
+ */
+int st_sim_write_ppm(uint8_t panel, const char *path);
+
+#endif /* ST7789_SIM_H_ */
@@ -23,658 +23,4953 @@ SOFTWARE.
 */
 
 #include "st7789_stm32_spi.h"
-#define ST_BUFFER_SIZE_BYTES	256
-//TFT width and height default global variables
-uint16_t st_tftwidth = 240;
-uint16_t st_tftheight = 240;
+#include <libopencm3/cm3/scs.h>
+#include <libopencm3/cm3/dwt.h>
+
+
+/*
+ * Transfer job queue.
+ * Everything sent to the display is described by a job. Commands and a few bytes of
+ * data are written by the CPU. Data buffers and fills are handed over to DMA, and the
+ * DMA transfer complete interrupt starts the next job. So, drawing functions return
+ * as soon as their jobs are queued and the CPU is free while pixels are being sent.
+ * Without DMA, jobs are written by the CPU as soon as they are queued.
+ */
+#define ST_JOB_CMD			0	// command byte + up to 4 parameter bytes (copied)
+#define ST_JOB_BYTES		1	// up to 4 data bytes (copied)
+#define ST_JOB_DATA			2	// data buffer owned by the caller
+#define ST_JOB_FILL			3	// `len` pixels of `color`
+#define ST_JOB_CALLBACK		4	// user callback
+#define ST_JOB_DATA16		5	// RGB565 pixel buffer (native uint16_t) owned by the caller
+#define ST_JOB_REPEAT		6	// `len` pixels of a buffer of `period` pixels, sent again and again
+
+/*
+ * Display list.
+ * While recording, drawing functions store opaque rectangles in the display's list instead
+ * of queueing jobs. Everything the driver draws is a rectangle of one color or a bitmap, so the
+ * list knows exactly which pixels each item covers and can remove overdraw before sending.
+ */
+#ifdef ST_USE_DISPLAY_LIST
+	#define ST_DL_FILL			0	// rectangle of `color`
+	#define ST_DL_BITMAP		1	// tImage data (big-endian bytes)
+	#define ST_DL_BITMAP16		2	// tImage16bit data (native uint16_t)
+
+	static void _st_dlist_send(st_display_t *disp);
+#endif
+
+static void _st_set_window(st_display_t *disp, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+
+
+/*
+ * Switch SPI between 8-bit and 16-bit data frames.
+ * DFF can only be changed while SPI is disabled, so wait until the bus is idle first.
+ */
+static void _st_spi_set_16bit(st_display_t *disp, uint8_t enable)
+{
+	if (disp->spi_16bit == enable)
+		return;
+
+	ST_WAIT_SPI_IDLE(disp->spi);
+	SPI_CR1(disp->spi) &= ~SPI_CR1_SPE;
+	if (enable)
+		SPI_CR1(disp->spi) |= SPI_CR1_DFF_16BIT;
+	else
+		SPI_CR1(disp->spi) &= ~SPI_CR1_DFF_16BIT;
+	SPI_CR1(disp->spi) |= SPI_CR1_SPE;
+	disp->spi_16bit = enable;
+}
+
+
+/*
+ * Wait `cycles` core clock cycles, counted with the DWT cycle counter
+ */
+static void _st_delay_cycles(uint32_t cycles)
+{
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	uint32_t start = DWT_CYCCNT;
+	while (DWT_CYCCNT - start < cycles);
+}
+
+
+/*
+ * Set D/C pin. 1: data, 0: command.
+ * The pin is changed only after the last frame has left the bus.
+ */
+static void _st_set_dc(st_display_t *disp, uint8_t data)
+{
+	if (disp->dc_data == data)
+		return;
+
+	ST_WAIT_SPI_IDLE(disp->spi);
+	if (data)
+		ST_DC_DAT(disp);
+	else
+		ST_DC_CMD(disp);
+	disp->dc_data = data;
+}
+
+
+/*
+ * Write `len` pixels of `color` with the CPU. SPI must be in 16-bit mode.
+ */
+static void _st_cpu_write_fill(st_display_t *disp, uint16_t color, uint32_t len)
+{
+	/*
+	* Here, macros are directly called (instead of inline functions) for performance increase
+	*/
+	uint16_t blocks = (uint16_t)(len / 64); // 64 pixels/block
+	uint8_t  pass_count;
+
+	while(blocks--)
+	{
+		pass_count = 16;
+		while(pass_count--)
+		{
+			ST_WRITE_16BIT(disp->spi, color); ST_WRITE_16BIT(disp->spi, color); ST_WRITE_16BIT(disp->spi, color); ST_WRITE_16BIT(disp->spi, color); //4
+		}
+	}
+	pass_count = len & 63;
+	while (pass_count--)
+	{
+		// write here the remaining data
+		ST_WRITE_16BIT(disp->spi, color);
+	}
+}
+
+
+/*
+ * Write `len` bytes from `data` with the CPU. SPI must be in 8-bit mode.
+ */
+static void _st_cpu_write_data(st_display_t *disp, const uint8_t *data, uint32_t len)
+{
+	while (len--)
+		ST_WRITE_8BIT(disp->spi, *data++);
+}
+
+
+/*
+ * Write `len` pixels from `data` with the CPU. SPI must be in 16-bit mode.
+ */
+static void _st_cpu_write_data16(st_display_t *disp, const uint16_t *data, uint32_t len)
+{
+	while (len--)
+		ST_WRITE_16BIT(disp->spi, *data++);
+}
+
+
+#ifdef ST_USE_SPI_DMA
+
+/*
+ * Start DMA transfer of the next chunk of a DATA or FILL job
+ */
+static void _st_dma_start(st_display_t *disp, st_job_t *job)
+{
+	const void *src;
+
+	DMA_CCR(disp->dma, disp->dma_channel) &= ~(DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_MSIZE_MASK | DMA_CCR_PSIZE_MASK);
+	disp->dma_chunk = (job->len < 0xFFFF) ? job->len : 0xFFFF;
+	if (job->type == ST_JOB_FILL)
+	{
+		// The same 16-bit color is sent again and again. No memory increment, no buffer.
+		// SPI is already in 16-bit mode, so each DMA request sends one whole pixel.
+		DMA_CCR(disp->dma, disp->dma_channel) |= DMA_CCR_PSIZE_16BIT | DMA_CCR_MSIZE_16BIT;
+		src = &job->color;
+	}
+	else if (job->type == ST_JOB_DATA16)
+	{
+		// One DMA request per pixel
+		DMA_CCR(disp->dma, disp->dma_channel) |= DMA_CCR_MINC | DMA_CCR_PSIZE_16BIT | DMA_CCR_MSIZE_16BIT;
+		src = job->data;
+	}
+	else if (job->type == ST_JOB_REPEAT)
+	{
+		// Circular mode: the channel goes back to the start of the buffer by itself,
+		// and the interrupt only counts the rounds (see st_dma_isr())
+		DMA_CCR(disp->dma, disp->dma_channel) |= DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PSIZE_16BIT | DMA_CCR_MSIZE_16BIT;
+		src = job->data;
+		disp->dma_chunk = job->period;
+	}
+	else
+	{
+		// memory increment enabled, peripheral and memory data size set to 8 bit
+		DMA_CCR(disp->dma, disp->dma_channel) |= DMA_CCR_MINC | DMA_CCR_PSIZE_8BIT | DMA_CCR_MSIZE_8BIT;
+		src = job->data;
+	}
+
+	// Set memory source address
+	DMA_CMAR(disp->dma, disp->dma_channel) = (uintptr_t)src;
+	// set data count
+	DMA_CNDTR(disp->dma, disp->dma_channel) = disp->dma_chunk;
+
+	// Enable DMA channel
+	DMA_CCR(disp->dma, disp->dma_channel) |= DMA_CCR_EN;
+	// Enable SPI DMA. This will start the DMA transaction
+	SPI_CR2(disp->spi) |= SPI_CR2_TXDMAEN;
+}
+
+#endif
+
+
+/*
+ * Send queued jobs until the queue is empty or a DMA transfer is started.
+ * Called with the DMA interrupt disabled, or from the DMA interrupt itself.
+ */
+static void _st_queue_run(st_display_t *disp)
+{
+	#ifdef ST_RELEASE_WHEN_IDLE
+		ST_CS_ACTIVE(disp);
+	#endif
+	disp->queue_active = 1;
+
+	while (disp->queue_head != disp->queue_tail)
+	{
+		st_job_t *job = &disp->queue[disp->queue_head];
+
+		uint8_t is_pixels = (job->type == ST_JOB_FILL || job->type == ST_JOB_DATA16 || job->type == ST_JOB_REPEAT);
+		// Pixels are sent as 16-bit frames, commands and byte data as 8-bit frames
+		_st_spi_set_16bit(disp, is_pixels);
+
+		#ifdef ST_USE_SPI_DMA
+			// A round of circular DMA must be long enough for its interrupt
+			uint8_t use_dma = (job->type == ST_JOB_DATA && job->len >= ST_DMA_MIN_BYTES) ||
+							  (job->type == ST_JOB_REPEAT && job->period * 2 >= ST_DMA_MIN_BYTES) ||
+							  (is_pixels && job->type != ST_JOB_REPEAT && job->len * 2 >= ST_DMA_MIN_BYTES);
+			if (use_dma)
+			{
+				_st_set_dc(disp, 1);
+				// DMA interrupt takes over from here
+				_st_dma_start(disp, job);
+				return;
+			}
+		#endif
+
+		switch (job->type)
+		{
+			case ST_JOB_CMD:
+				_st_set_dc(disp, 0);
+				ST_WRITE_8BIT(disp->spi, job->cmd);
+				_st_set_dc(disp, 1);
+				_st_cpu_write_data(disp, job->bytes, job->n_bytes);
+				break;
+
+			case ST_JOB_BYTES:
+				_st_set_dc(disp, 1);
+				_st_cpu_write_data(disp, job->bytes, job->n_bytes);
+				break;
+
+			case ST_JOB_DATA:
+				_st_set_dc(disp, 1);
+				_st_cpu_write_data(disp, job->data, job->len);
+				break;
+
+			case ST_JOB_FILL:
+				_st_set_dc(disp, 1);
+				_st_cpu_write_fill(disp, job->color, job->len);
+				break;
+
+			case ST_JOB_DATA16:
+				_st_set_dc(disp, 1);
+				_st_cpu_write_data16(disp, (const uint16_t *)job->data, job->len);
+				break;
+
+			case ST_JOB_REPEAT:
+				_st_set_dc(disp, 1);
+				for (uint32_t left = job->len; left; left -= (left < job->period) ? left : job->period)
+					_st_cpu_write_data16(disp, (const uint16_t *)job->data, (left < job->period) ? left : job->period);
+				break;
+
+			case ST_JOB_CALLBACK:
+				// Previous jobs are completely sent only when the bus is idle
+				ST_WAIT_SPI_IDLE(disp->spi);
+				job->callback((void *)job->data);
+				break;
+		}
+
+		disp->queue_head = (disp->queue_head + 1) % ST_QUEUE_LEN;
+	}
+
+	disp->queue_active = 0;
+	#ifdef ST_RELEASE_WHEN_IDLE
+		ST_WAIT_SPI_IDLE(disp->spi);
+		ST_CS_IDLE(disp);
+	#endif
+}
+
+
+#ifdef ST_USE_SPI_DMA
+
+/**
+ * DMA transfer complete interrupt handler of a display. Starts the next chunk or the next job.
+ * Called from the ISR of the display's DMA channel.
+ * @param disp display using this DMA channel
+ */
+void st_dma_isr(st_display_t *disp)
+{
+	if (!(DMA_ISR(disp->dma) & DMA_ISR_TCIF(disp->dma_channel)))
+		return;
+
+	st_job_t *job = &disp->queue[disp->queue_head];
+	job->len -= disp->dma_chunk;
+
+	// Circular transfer is already sending the next round
+	if (job->type == ST_JOB_REPEAT && job->len)
+	{
+		DMA_IFCR(disp->dma) = DMA_IFCR_CGIF(disp->dma_channel);
+		return;
+	}
+
+	// Last frames may still be in the SPI. Don't wait for them here, whoever changes
+	// D/C, CS or SPI settings next waits for the bus to be idle.
+
+	// Disable SPI DMA tx
+	SPI_CR2(disp->spi) &= ~SPI_CR2_TXDMAEN;
+	// Disable DMA channel
+	DMA_CCR(disp->dma, disp->dma_channel) &= ~DMA_CCR_EN;
+	DMA_IFCR(disp->dma) = DMA_IFCR_CGIF(disp->dma_channel);
+
+	if (job->type == ST_JOB_DATA)
+		job->data += disp->dma_chunk;
+	else if (job->type == ST_JOB_DATA16)
+		job->data += disp->dma_chunk * 2;
+
+	if (job->len)
+	{
+		_st_dma_start(disp, job);
+		return;
+	}
+
+	disp->queue_head = (disp->queue_head + 1) % ST_QUEUE_LEN;
+	_st_queue_run(disp);
+}
+
+#endif
+
+
+/*
+ * Address window cache.
+ * `win_*` fields of the display mirror the column/row window of the controller as it will be
+ * once all queued jobs are sent, so st_set_address_window() can skip CASET/RASET that wouldn't
+ * change anything. If RAMWR was the last command and the data written since then exactly fills
+ * the window (write pointer wrapped back to the start), RAMWR is skipped too.
+ * This function keeps the cache in sync with a job that's going to be queued.
+ */
+static void _st_track_window(st_display_t *disp, const st_job_t *job)
+{
+	uint32_t bytes = 0;
+
+	switch (job->type)
+	{
+		case ST_JOB_CMD:
+			disp->win_ramwr_open = 0;
+			if (job->cmd == ST7789_RAMWR)
+			{
+				disp->win_ramwr_open = 1;
+				disp->win_written = 0;
+			}
+			else if (job->cmd == ST7789_CASET && job->n_bytes == 4)
+			{
+				disp->win_x1 = ((uint16_t)job->bytes[0] << 8) | job->bytes[1];
+				disp->win_x2 = ((uint16_t)job->bytes[2] << 8) | job->bytes[3];
+			}
+			else if (job->cmd == ST7789_RASET && job->n_bytes == 4)
+			{
+				disp->win_y1 = ((uint16_t)job->bytes[0] << 8) | job->bytes[1];
+				disp->win_y2 = ((uint16_t)job->bytes[2] << 8) | job->bytes[3];
+			}
+			else
+			{
+				if (job->cmd == ST7789_MADCTL && job->n_bytes)
+					disp->madctl = job->bytes[0];
+				// Any other command (reset, rotation etc.) may move the window
+				disp->win_valid = 0;
+			}
+			return;
+
+		case ST_JOB_BYTES:	bytes = job->n_bytes;	break;
+		case ST_JOB_DATA:	bytes = job->len;		break;
+		case ST_JOB_FILL:
+		case ST_JOB_DATA16:	bytes = job->len * 2;	break;
+		case ST_JOB_REPEAT:
+			// Circular DMA may send a few pixels more before it's stopped, so the write
+			// pointer is not known (see _st_queue_repeat())
+			disp->win_ramwr_open = 0;
+			return;
+		default:			return;
+	}
+
+	if (disp->win_ramwr_open)
+	{
+		uint32_t win_bytes = (uint32_t)(disp->win_x2 - disp->win_x1 + 1) * (uint32_t)(disp->win_y2 - disp->win_y1 + 1) * 2;
+		disp->win_written = (disp->win_written + bytes % win_bytes) % win_bytes;
+	}
+}
+
+
+#ifdef ST_USE_SHADOW
+
+/*
+ * Shadow buffer.
+ * Every pixel written to the panel is also written to the shadow as a small key: 1 - 3 for the
+ * colors set with st_set_shadow(), 0 for any other color. Pixels are tracked while jobs are
+ * queued, through the same window and write pointer as the address window cache. The shadow
+ * is kept in panel (MADCTL 0) coordinates, so it stays right across rotations.
+ */
+
+/*
+ * Key of a color in the shadow
+ */
+static uint8_t _st_shadow_key(const st_display_t *disp, uint16_t color)
+{
+	for (uint8_t i = 0; i < (1 << disp->shadow_bpp) - 1; i++)
+		if (disp->shadow_colors[i] == color)
+			return i + 1;
+	return 0;
+}
+
+/*
+ * Size of the panel in its own coordinates
+ */
+static void _st_panel_size(const st_display_t *disp, uint16_t *w, uint16_t *h)
+{
+	*w = (disp->rotation >= 2) ? disp->height : disp->width;
+	*h = (disp->rotation >= 2) ? disp->width : disp->height;
+}
+
+/*
+ * Panel position of a window position (x,y), as the controller maps it with MADCTL
+ */
+static void _st_shadow_map(const st_display_t *disp, uint16_t x, uint16_t y, uint16_t *col, uint16_t *row)
+{
+	uint16_t pw, ph;
+	_st_panel_size(disp, &pw, &ph);
+	*col = (disp->madctl & ST7789_MADCTL_MV) ? y : x;
+	*row = (disp->madctl & ST7789_MADCTL_MV) ? x : y;
+	if (disp->madctl & ST7789_MADCTL_MX)
+		*col = pw - 1 - *col;
+	if (disp->madctl & ST7789_MADCTL_MY)
+		*row = ph - 1 - *row;
+}
+
+/*
+ * Set `n` keys of the shadow, starting at pixel `index` of the panel
+ */
+static void _st_shadow_set(st_display_t *disp, uint32_t index, uint32_t n, uint8_t key)
+{
+	uint8_t bpp = disp->shadow_bpp;
+	uint32_t bit = index * bpp;
+	uint32_t bits = n * bpp;
+	uint8_t *p = disp->shadow + bit / 8;
+	uint8_t fill = (bpp == 1) ? (uint8_t)(0 - key) : (uint8_t)(key * 0x55);	// key in every slot of a byte
+
+	if (bit % 8)
+	{
+		uint8_t k = (uint8_t)(8 - bit % 8);
+		if (k > bits)
+			k = (uint8_t)bits;
+		uint8_t mask = (uint8_t)(((1u << k) - 1) << (bit % 8));
+		*p = (*p & ~mask) | (fill & mask);
+		p++;
+		bits -= k;
+	}
+	for (; bits >= 8; bits -= 8)
+		*p++ = fill;
+	if (bits)
+	{
+		uint8_t mask = (uint8_t)((1u << bits) - 1);
+		*p = (*p & ~mask) | (fill & mask);
+	}
+}
+
+/*
+ * Key of the pixel at (x,y) of the screen
+ */
+static uint8_t _st_shadow_get(const st_display_t *disp, uint16_t x, uint16_t y)
+{
+	uint16_t col, row, pw, ph;
+	_st_panel_size(disp, &pw, &ph);
+	_st_shadow_map(disp, x, y, &col, &row);
+	uint32_t bit = ((uint32_t)row * pw + col) * disp->shadow_bpp;
+	return (disp->shadow[bit / 8] >> (bit % 8)) & ((1 << disp->shadow_bpp) - 1);
+}
+
+/*
+ * Set the keys of `n` pixels written from position `pos` of the address window
+ */
+static void _st_shadow_write(st_display_t *disp, uint32_t pos, uint32_t n, uint8_t key)
+{
+	uint16_t w = disp->win_x2 - disp->win_x1 + 1;
+	uint32_t size = (uint32_t)w * (uint32_t)(disp->win_y2 - disp->win_y1 + 1);
+	uint16_t pw, ph;
+	_st_panel_size(disp, &pw, &ph);
+
+	pos %= size;
+	while (n)
+	{
+		// Up to the end of the window row
+		uint16_t x = disp->win_x1 + pos % w;
+		uint16_t y = disp->win_y1 + pos / w;
+		uint16_t run = w - pos % w;
+		if (run > n)
+			run = (uint16_t)n;
+
+		uint16_t col, row;
+		_st_shadow_map(disp, x, y, &col, &row);
+		if (!(disp->madctl & ST7789_MADCTL_MV))
+		{
+			// A window row is a panel row
+			if (disp->madctl & ST7789_MADCTL_MX)
+				col -= run - 1;
+			if (row < ph && col < pw)
+				_st_shadow_set(disp, (uint32_t)row * pw + col, (col + run <= pw) ? run : pw - col, key);
+		}
+		else
+		{
+			// A window row is a panel column
+			for (uint16_t i = 0; i < run; i++)
+			{
+				_st_shadow_map(disp, x + i, y, &col, &row);
+				if (row < ph && col < pw)
+					_st_shadow_set(disp, (uint32_t)row * pw + col, 1, key);
+			}
+		}
+
+		n -= run;
+		pos += run;
+		if (pos == size)
+			pos = 0;
+	}
+}
+
+/*
+ * Runs of pixels with the same key are written to the shadow together
+ */
+typedef struct
+{
+	uint32_t pos;		// window position of the run
+	uint32_t len;
+	uint8_t key;
+} st_shadow_run_t;
+
+static void _st_shadow_put(st_display_t *disp, st_shadow_run_t *run, uint16_t color)
+{
+	uint8_t key = _st_shadow_key(disp, color);
+	if (run->len && key != run->key)
+	{
+		_st_shadow_write(disp, run->pos, run->len, run->key);
+		run->pos += run->len;
+		run->len = 0;
+	}
+	run->key = key;
+	run->len++;
+}
+
+/*
+ * Update the shadow with the pixels of a job that's going to be queued.
+ * Called before _st_track_window() moves the write pointer past them.
+ */
+static void _st_shadow_track(st_display_t *disp, const st_job_t *job)
+{
+	if (!disp->win_valid || !disp->win_ramwr_open)
+		return;
+
+	st_shadow_run_t run = {disp->win_written / 2, 0, 0};
+	uint32_t odd = disp->win_written % 2;	// first byte of a pixel already sent
+	const uint8_t *bytes = (job->type == ST_JOB_BYTES) ? job->bytes : job->data;
+	const uint16_t *pixels = (const uint16_t *)job->data;
+
+	switch (job->type)
+	{
+		case ST_JOB_FILL:
+			_st_shadow_write(disp, run.pos, job->len, _st_shadow_key(disp, job->color));
+			return;
+
+		case ST_JOB_DATA16:
+			for (uint32_t i = 0; i < job->len; i++)
+				_st_shadow_put(disp, &run, pixels[i]);
+			break;
+
+		case ST_JOB_REPEAT:
+			for (uint32_t i = 0; i < job->len; i++)
+				_st_shadow_put(disp, &run, pixels[i % job->period]);
+			break;
+
+		case ST_JOB_BYTES:
+		case ST_JOB_DATA:
+		{
+			// Pixels are big-endian byte pairs, which may be split across jobs
+			uint32_t len = (job->type == ST_JOB_BYTES) ? job->n_bytes : job->len;
+			for (uint32_t i = 0; i < len; i++, odd ^= 1)
+			{
+				if (!odd)
+					disp->shadow_high = bytes[i];
+				else
+					_st_shadow_put(disp, &run, (uint16_t)(disp->shadow_high << 8) | bytes[i]);
+			}
+			break;
+		}
+
+		default:
+			return;
+	}
+
+	if (run.len)
+		_st_shadow_write(disp, run.pos, run.len, run.key);
+}
+
+
+/**
+ * Keep a shadow of the screen in `buffer`, so st_flood_fill() doesn't have to read the panel.
+ * Every pixel takes `bpp` bits, telling which of `colors` it has, or none of them. Everything
+ * drawn from now on is tracked. The buffer is cleared (no color), so set it before drawing the screen.
+ * @param disp display
+ * @param buffer width x height x bpp / 8 bytes (7200 for 240x240 at 1 bpp), NULL to stop using a shadow
+ * @param bpp bits per pixel, 1 or 2
+ * @param colors 1 color (1 bpp) or 3 colors (2 bpp) that st_flood_fill() tells apart
+ */
+void st_set_shadow(st_display_t *disp, uint8_t *buffer, uint8_t bpp, const uint16_t *colors)
+{
+	uint16_t pw, ph;
+	_st_panel_size(disp, &pw, &ph);
+
+	disp->shadow = buffer;
+	disp->shadow_bpp = (bpp == 2) ? 2 : 1;
+	for (uint8_t i = 0; i < (1 << disp->shadow_bpp) - 1; i++)
+		disp->shadow_colors[i] = colors[i];
+	if (buffer)
+		_st_shadow_set(disp, 0, (uint32_t)pw * ph, 0);
+}
+
+#endif
+
+
+/*
+ * Copy a job into the queue and start sending if the driver is idle
+ */
+static void _st_queue_push(st_display_t *disp, const st_job_t *job)
+{
+	#ifdef ST_USE_DISPLAY_LIST
+		// Something not recordable is sent, so whatever was recorded before it must go first
+		if (disp->dlist_recording)
+			_st_dlist_send(disp);
+	#endif
+
+	#ifdef ST_USE_SHADOW
+		if (disp->shadow)
+			_st_shadow_track(disp, job);
+	#endif
+	_st_track_window(disp, job);
+
+	while ((uint8_t)((disp->queue_tail + 1) % ST_QUEUE_LEN) == disp->queue_head)
+	{
+		// Wait for a free slot. DMA interrupt frees them.
+	}
+
+	#ifdef ST_USE_SPI_DMA
+		nvic_disable_irq(disp->dma_irq);
+	#endif
+
+	disp->queue[disp->queue_tail] = *job;
+	// Job must be in memory before the interrupt can see it
+	ST_COMPILER_BARRIER();
+	disp->queue_tail = (disp->queue_tail + 1) % ST_QUEUE_LEN;
+	if (!disp->queue_active)
+		_st_queue_run(disp);
+	ST_COMPILER_BARRIER();
+
+	#ifdef ST_USE_SPI_DMA
+		nvic_enable_irq(disp->dma_irq);
+	#endif
+}
+
+
+/**
+ * Queue a command byte followed by up to 4 parameter bytes.
+ * Parameters are copied, so the caller's buffer can be reused right away.
+ * @param disp display
+ * @param cmd command byte (sent with D/C low)
+ * @param params pointer to the parameter bytes, may be NULL if `n_params` is 0
+ * @param n_params number of parameter bytes (max 4)
+ */
+void st_queue_command(st_display_t *disp, uint8_t cmd, const uint8_t *params, uint8_t n_params)
+{
+	st_job_t job;
+	job.type = ST_JOB_CMD;
+	job.cmd = cmd;
+	job.n_bytes = (n_params > 4) ? 4 : n_params;
+	for (uint8_t i = 0; i < job.n_bytes; i++)
+		job.bytes[i] = params[i];
+	_st_queue_push(disp, &job);
+}
+
+
+/**
+ * Queue up to 4 data bytes. Bytes are copied into the queue.
+ * @param disp display
+ * @param bytes pointer to the data bytes
+ * @param n_bytes number of bytes (max 4)
+ */
+void st_queue_bytes(st_display_t *disp, const uint8_t *bytes, uint8_t n_bytes)
+{
+	st_job_t job;
+	job.type = ST_JOB_BYTES;
+	job.n_bytes = (n_bytes > 4) ? 4 : n_bytes;
+	for (uint8_t i = 0; i < job.n_bytes; i++)
+		job.bytes[i] = bytes[i];
+	_st_queue_push(disp, &job);
+}
+
+
+/**
+ * Queue a data buffer to be sent to the display.
+ * The buffer is NOT copied. It must stay valid until the transfer completes
+ * (see `st_wait_idle()` and `st_queue_callback()`).
+ * @param disp display
+ * @param data pointer to the data
+ * @param len number of bytes
+ */
+void st_queue_data(st_display_t *disp, const void *data, uint32_t len)
+{
+	if (len == 0)
+		return;
+	st_job_t job;
+	job.type = ST_JOB_DATA;
+	job.data = (const uint8_t *)data;
+	job.len = len;
+	_st_queue_push(disp, &job);
+}
+
+
+/**
+ * Queue a buffer of RGB565 pixels to be sent to the display as 16-bit SPI frames.
+ * Pixels are native `uint16_t` values, so no byte swapping is needed.
+ * The buffer is NOT copied. It must stay valid until the transfer completes.
+ * @param disp display
+ * @param data pointer to the pixels
+ * @param len number of pixels
+ */
+void st_queue_data16(st_display_t *disp, const uint16_t *data, uint32_t len)
+{
+	if (len == 0)
+		return;
+	st_job_t job;
+	job.type = ST_JOB_DATA16;
+	job.data = (const uint8_t *)data;
+	job.len = len;
+	_st_queue_push(disp, &job);
+}
+
+
+/*
+ * Queue a buffer of `period` RGB565 pixels to be sent again and again, `len` pixels in total.
+ * With DMA, this is one circular transfer, and the interrupt only counts the rounds. The channel
+ * may send a few more pixels before the last interrupt stops it. So the job must start at the
+ * start of the address window, and `len` must be the size of the window and a multiple of
+ * `period`: then the extra pixels wrap around and write the same colors again.
+ * The buffer is NOT copied. It must stay valid until the transfer completes.
+ */
+static void _st_queue_repeat(st_display_t *disp, const uint16_t *data, uint16_t period, uint32_t len)
+{
+	if (len == 0)
+		return;
+	st_job_t job;
+	job.type = ST_JOB_REPEAT;
+	job.data = (const uint8_t *)data;
+	job.period = period;
+	job.len = len;
+	_st_queue_push(disp, &job);
+}
+
+
+/**
+ * Queue `len` pixels of `color`. Same as `st_fill_color()`.
+ * @param disp display
+ * @param color 16-bit RGB565 color value
+ * @param len 32-bit number of pixels
+ */
+void st_queue_fill(st_display_t *disp, uint16_t color, uint32_t len)
+{
+	if (len == 0)
+		return;
+	st_job_t job;
+	if (len <= 2)
+	{
+		// A pixel or two fit in the job itself
+		job.type = ST_JOB_BYTES;
+		job.n_bytes = (uint8_t)(len * 2);
+		job.bytes[0] = job.bytes[2] = (uint8_t)(color >> 8);
+		job.bytes[1] = job.bytes[3] = (uint8_t)color;
+	}
+	else
+	{
+		job.type = ST_JOB_FILL;
+		job.color = color;
+		job.len = len;
+	}
+	_st_queue_push(disp, &job);
+}
+
+
+/**
+ * Queue a callback. It is called once all jobs queued before it are sent.
+ * @param disp display
+ * @param callback function to call
+ * @param arg argument passed to `callback`
+ */
+void st_queue_callback(st_display_t *disp, st_callback_t callback, void *arg)
+{
+	st_job_t job;
+	job.type = ST_JOB_CALLBACK;
+	job.callback = callback;
+	job.data = (const uint8_t *)arg;
+	_st_queue_push(disp, &job);
+}
+
+
+/**
+ * Block until all queued jobs are sent and the SPI bus is idle.
+ * Call it before touching memory that was passed to `st_queue_data()` or `st_draw_bitmap()`.
+ */
+void st_wait_idle(st_display_t *disp)
+{
+	while (disp->queue_active);
+	ST_WAIT_SPI_IDLE(disp->spi);
+}
+
+
+/**
+ * Check if there are queued jobs which are not sent yet.
+ * @return 1 if the driver is still sending, 0 if idle
+ */
+uint8_t st_is_busy(st_display_t *disp)
+{
+	return disp->queue_active;
+}
+
+
+/*
+ * Called from the queue once a half of the pixel staging buffer is sent
+ */
+static void _st_pixbuf_release(void *arg)
+{
+	*(volatile uint8_t *)arg = 0;
+}
+
+/*
+ * Get room for `len` (max ST_PIXBUF_LEN / 2) generated pixels, to be queued with st_queue_data16().
+ * When the current half is full, a callback is queued to release it once sent, and filling goes on
+ * in the other half (waiting until that one is sent). Pixels must be queued before the next call.
+ * The buffer must not be recorded in the display list, so call st_set_address_window() first.
+ */
+static uint16_t *_st_pixbuf_get(st_display_t *disp, uint16_t len)
+{
+	if (disp->pixbuf_used + len > ST_PIXBUF_LEN / 2)
+	{
+		uint8_t half = disp->pixbuf_half;
+		disp->pixbuf_busy[half] = 1;
+		st_queue_callback(disp, _st_pixbuf_release, (void *)&disp->pixbuf_busy[half]);
+
+		half ^= 1;
+		while (disp->pixbuf_busy[half]);
+		disp->pixbuf_half = half;
+		disp->pixbuf_used = 0;
+	}
+
+	uint16_t *buf = &disp->pixbuf[disp->pixbuf_half * (ST_PIXBUF_LEN / 2) + disp->pixbuf_used];
+	disp->pixbuf_used += len;
+	return buf;
+}
+
+
+#ifdef ST_USE_DISPLAY_LIST
+
+/*
+ * Check if two rectangles share at least one pixel
+ */
+static uint8_t _st_dl_overlap(const st_dl_item_t *a, const st_dl_item_t *b)
+{
+	return (uint32_t)a->x < (uint32_t)b->x + b->w && (uint32_t)b->x < (uint32_t)a->x + a->w &&
+		   (uint32_t)a->y < (uint32_t)b->y + b->h && (uint32_t)b->y < (uint32_t)a->y + a->h;
+}
+
+
+/*
+ * Check if two fills of the same color touch along a whole side, so together they make one rectangle.
+ * If so, `a` is grown to cover both.
+ */
+static uint8_t _st_dl_merge(st_dl_item_t *a, const st_dl_item_t *b)
+{
+	if (a->type != ST_DL_FILL || b->type != ST_DL_FILL || a->color != b->color)
+		return 0;
+
+	if (a->y == b->y && a->h == b->h && ((uint32_t)a->x + a->w == b->x || (uint32_t)b->x + b->w == a->x))
+	{
+		if (b->x < a->x)
+			a->x = b->x;
+		a->w += b->w;
+		return 1;
+	}
+	if (a->x == b->x && a->w == b->w && ((uint32_t)a->y + a->h == b->y || (uint32_t)b->y + b->h == a->y))
+	{
+		if (b->y < a->y)
+			a->y = b->y;
+		a->h += b->h;
+		return 1;
+	}
+	return 0;
+}
+
+
+/*
+ * Remove item `i` from the list
+ */
+static void _st_dl_remove(st_display_t *disp, uint8_t i)
+{
+	disp->dlist_len--;
+	for (; i < disp->dlist_len; i++)
+		disp->dlist[i] = disp->dlist[i + 1];
+}
+
+
+/*
+ * Drop or cut fills that are (partly) hidden by a later item.
+ * The hidden part of fill `i` is cut out by replacing `i` with up to 4 pieces
+ * (bands above and below the hidden part, and pieces left and right of it).
+ */
+static void _st_dl_remove_overdraw(st_display_t *disp)
+{
+	uint8_t i = 0;
+
+	while (i < disp->dlist_len)
+	{
+		st_dl_item_t *a = &disp->dlist[i];
+		uint8_t cut = 0;
+
+		for (uint8_t j = i + 1; j < disp->dlist_len && !cut; j++)
+		{
+			const st_dl_item_t *b = &disp->dlist[j];
+			if (!_st_dl_overlap(a, b))
+				continue;
+
+			// Hidden part of `a`
+			uint16_t hx1 = (a->x > b->x) ? a->x : b->x;
+			uint16_t hy1 = (a->y > b->y) ? a->y : b->y;
+			uint16_t hx2 = ((uint32_t)a->x + a->w < (uint32_t)b->x + b->w) ? a->x + a->w : b->x + b->w;
+			uint16_t hy2 = ((uint32_t)a->y + a->h < (uint32_t)b->y + b->h) ? a->y + a->h : b->y + b->h;
+
+			st_dl_item_t pieces[4];
+			uint8_t n = 0;
+			if (hy1 > a->y)
+				{ pieces[n] = *a; pieces[n].h = hy1 - a->y; n++; }
+			if (hy2 < a->y + a->h)
+				{ pieces[n] = *a; pieces[n].y = hy2; pieces[n].h = a->y + a->h - hy2; n++; }
+			if (hx1 > a->x)
+				{ pieces[n] = *a; pieces[n].y = hy1; pieces[n].h = hy2 - hy1; pieces[n].w = hx1 - a->x; n++; }
+			if (hx2 < a->x + a->w)
+				{ pieces[n] = *a; pieces[n].x = hx2; pieces[n].y = hy1; pieces[n].h = hy2 - hy1; pieces[n].w = a->x + a->w - hx2; n++; }
+
+			// Completely hidden items are always dropped. Bitmaps can't be cut.
+			// Splitting a fill into more pieces must save more than the extra window setups cost.
+			if (n == 0)
+				cut = 1;
+			else if (a->type == ST_DL_FILL &&
+					 (n == 1 || ((uint32_t)(hx2 - hx1) * (hy2 - hy1) >= ST_DLIST_MIN_CUT && disp->dlist_len + n - 1 <= ST_DLIST_LEN)))
+				cut = 1;
+
+			if (cut)
+			{
+				_st_dl_remove(disp, i);
+				// Pieces take the place of `a`. They are checked again from the next pass.
+				for (uint8_t k = disp->dlist_len; k > i; k--)
+					disp->dlist[k + n - 1] = disp->dlist[k - 1];
+				for (uint8_t k = 0; k < n; k++)
+					disp->dlist[i + k] = pieces[k];
+				disp->dlist_len += n;
+			}
+		}
+
+		if (!cut)
+			i++;
+	}
+}
+
+
+/*
+ * Merge fills of the same color that touch along a whole side.
+ * Merged fill is drawn at the time of one of the two, so the other one must not
+ * overlap anything drawn in between.
+ */
+static void _st_dl_merge_fills(st_display_t *disp)
+{
+	uint8_t merged;
+	do
+	{
+		merged = 0;
+		for (uint8_t i = 0; i < disp->dlist_len; i++)
+		{
+			for (uint8_t j = i + 1; j < disp->dlist_len; j++)
+			{
+				st_dl_item_t a = disp->dlist[i];
+				if (!_st_dl_merge(&a, &disp->dlist[j]))
+					continue;
+
+				uint8_t i_free = 1, j_free = 1;
+				for (uint8_t k = i + 1; k < j; k++)
+				{
+					if (_st_dl_overlap(&disp->dlist[k], &disp->dlist[i]))
+						i_free = 0;
+					if (_st_dl_overlap(&disp->dlist[k], &disp->dlist[j]))
+						j_free = 0;
+				}
+
+				if (i_free)
+				{
+					// `i` can be drawn later, at the time of `j`
+					disp->dlist[j] = a;
+					_st_dl_remove(disp, i);
+				}
+				else if (j_free)
+				{
+					// `j` can be drawn earlier, at the time of `i`
+					disp->dlist[i] = a;
+					_st_dl_remove(disp, j);
+				}
+				else
+					continue;
+
+				merged = 1;
+				break;
+			}
+		}
+	} while (merged);
+}
+
+
+/*
+ * Sort items top to bottom, then left to right, so consecutive items often share
+ * their rows and only need a CASET (see address window cache).
+ * Overlapping items never pass each other, so the result looks the same.
+ */
+static void _st_dl_sort(st_display_t *disp)
+{
+	for (uint8_t i = 1; i < disp->dlist_len; i++)
+	{
+		st_dl_item_t item = disp->dlist[i];
+		uint8_t k = i;
+		while (k > 0 && !_st_dl_overlap(&disp->dlist[k - 1], &item) &&
+			   (disp->dlist[k - 1].y > item.y || (disp->dlist[k - 1].y == item.y && disp->dlist[k - 1].x > item.x)))
+		{
+			disp->dlist[k] = disp->dlist[k - 1];
+			k--;
+		}
+		disp->dlist[k] = item;
+	}
+}
+
+
+/*
+ * Optimize the recorded list and queue it. Recording continues afterwards.
+ */
+static void _st_dlist_send(st_display_t *disp)
+{
+	_st_dl_remove_overdraw(disp);
+	_st_dl_merge_fills(disp);
+	_st_dl_sort(disp);
+
+	// Stop recording while the list itself is being queued
+	disp->dlist_recording = 0;
+	for (uint8_t i = 0; i < disp->dlist_len; i++)
+	{
+		const st_dl_item_t *item = &disp->dlist[i];
+		st_set_address_window(disp, item->x, item->y, item->x + item->w - 1, item->y + item->h - 1);
+		if (item->type == ST_DL_FILL)
+			st_queue_fill(disp, item->color, (uint32_t)item->w * (uint32_t)item->h);
+		else if (item->type == ST_DL_BITMAP)
+			st_queue_data(disp, item->data, (uint32_t)item->w * (uint32_t)item->h * 2);
+		else
+			st_queue_data16(disp, item->data, (uint32_t)item->w * (uint32_t)item->h);
+	}
+	disp->dlist_len = 0;
+	disp->dlist_recording = 1;
+}
+
+
+/*
+ * Add an item to the display list. It's merged into the previous item if possible.
+ */
+static void _st_dlist_add(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color, uint8_t type, const void *data)
+{
+	st_dl_item_t item = {x, y, w, h, color, type, data};
+
+	if (disp->dlist_len && _st_dl_merge(&disp->dlist[disp->dlist_len - 1], &item))
+		return;
+	if (disp->dlist_len == ST_DLIST_LEN)
+		_st_dlist_send(disp);
+	disp->dlist[disp->dlist_len++] = item;
+}
+
+
+/**
+ * Start recording drawing calls into the display list instead of sending them.
+ * Fills, lines, rectangles, pixels, text without background and bitmaps are recorded. Anything
+ * else (text with background, st_set_address_window(), st_queue_*() etc.) sends the recorded list first.
+ */
+void st_begin_list(st_display_t *disp)
+{
+	disp->dlist_recording = 1;
+}
+
+
+/**
+ * Send the recorded display list and stop recording.
+ * Fills hidden by later drawing are dropped or cut, touching fills of the same color
+ * are merged, and the result is sent in scanline order.
+ */
+void st_flush(st_display_t *disp)
+{
+	if (disp->dlist_recording)
+		_st_dlist_send(disp);
+	disp->dlist_recording = 0;
+}
+
+#endif
+
+
+/*
+ * Draw a rectangle of `color`. Every fill of the driver ends up here.
+ */
+static void _st_draw_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+{
+	#ifdef ST_USE_DISPLAY_LIST
+		if (disp->dlist_recording)
+		{
+			_st_dlist_add(disp, x, y, w, h, color, ST_DL_FILL, NULL);
+			return;
+		}
+	#endif
+
+	st_set_address_window(disp, x, y, x + w - 1, y + h - 1);
+	st_queue_fill(disp, color, (uint32_t)w * (uint32_t)h);
+}
+
+
+/*
+ * Translate a rectangle from drawing coordinates to the screen and clip it.
+ * Corners are inclusive. Returns 0 if nothing is left.
+ */
+static uint8_t _st_clip(st_display_t *disp, int16_t *x1, int16_t *y1, int16_t *x2, int16_t *y2)
+{
+	int32_t cx1 = (int32_t)*x1 + disp->origin_x;
+	int32_t cy1 = (int32_t)*y1 + disp->origin_y;
+	int32_t cx2 = (int32_t)*x2 + disp->origin_x;
+	int32_t cy2 = (int32_t)*y2 + disp->origin_y;
+
+	if (cx1 < disp->clip_x1)
+		cx1 = disp->clip_x1;
+	if (cy1 < disp->clip_y1)
+		cy1 = disp->clip_y1;
+	if (cx2 > disp->clip_x2)
+		cx2 = disp->clip_x2;
+	if (cy2 > disp->clip_y2)
+		cy2 = disp->clip_y2;
+	if (cx1 > cx2 || cy1 > cy2)
+		return 0;
+
+	*x1 = cx1;
+	*y1 = cy1;
+	*x2 = cx2;
+	*y2 = cy2;
+	return 1;
+}
+
+
+/*
+ * Fill a rectangle given by its corners in drawing coordinates, clipped.
+ * Every shape is filled through here.
+ */
+static void _st_fill_area(st_display_t *disp, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color)
+{
+	if (_st_clip(disp, &x1, &y1, &x2, &y2))
+		_st_draw_rect(disp, x1, y1, x2 - x1 + 1, y2 - y1 + 1, color);
+}
+
+/*
+ * _st_fill_area() for corners that may be outside int16_t range. They are cut to the clip rectangle first.
+ */
+static void _st_fill_area_wide(st_display_t *disp, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t color)
+{
+	int32_t left = disp->clip_x1 - disp->origin_x, top = disp->clip_y1 - disp->origin_y;
+	int32_t right = disp->clip_x2 - disp->origin_x, bottom = disp->clip_y2 - disp->origin_y;
+	if (x1 < left)
+		x1 = left;
+	if (y1 < top)
+		y1 = top;
+	if (x2 > right)
+		x2 = right;
+	if (y2 > bottom)
+		y2 = bottom;
+	if (x1 <= x2 && y1 <= y2)
+		_st_fill_area(disp, x1, y1, x2, y2, color);
+}
+
+
+/**
+ * Remove all clip rectangles and move the origin back to the top left corner of the screen.
+ * Called by st_init() and st_rotate_display().
+ * @param disp display
+ */
+void st_reset_clip(st_display_t *disp)
+{
+	disp->clip_depth = 0;
+	disp->origin_x = 0;
+	disp->origin_y = 0;
+	disp->clip_x1 = 0;
+	disp->clip_y1 = 0;
+	disp->clip_x2 = disp->width - 1;
+	disp->clip_y2 = disp->height - 1;
+}
+
+
+/**
+ * Limit drawing to a rectangle, inside the current clip rectangle.
+ * The current clip rectangle and origin are saved, st_pop_clip() restores them.
+ * @param disp display
+ * @param x start column, relative to the origin
+ * @param y start row, relative to the origin
+ * @param w width
+ * @param h height
+ * @return 1 if done, 0 if the stack is full (ST_CLIP_DEPTH). Don't call st_pop_clip() for a failed push.
+ */
+uint8_t st_push_clip(st_display_t *disp, int16_t x, int16_t y, uint16_t w, uint16_t h)
+{
+	if (disp->clip_depth == ST_CLIP_DEPTH)
+		return 0;
+
+	st_clip_t *saved = &disp->clip_stack[disp->clip_depth++];
+	saved->x1 = disp->clip_x1;
+	saved->y1 = disp->clip_y1;
+	saved->x2 = disp->clip_x2;
+	saved->y2 = disp->clip_y2;
+	saved->origin_x = disp->origin_x;
+	saved->origin_y = disp->origin_y;
+
+	int16_t x1 = x, y1 = y;
+	int16_t x2 = x + w - 1, y2 = y + h - 1;
+	if (w && h && _st_clip(disp, &x1, &y1, &x2, &y2))
+	{
+		disp->clip_x1 = x1;
+		disp->clip_y1 = y1;
+		disp->clip_x2 = x2;
+		disp->clip_y2 = y2;
+	}
+	else
+	{
+		// Nothing is visible
+		disp->clip_x1 = 1;
+		disp->clip_x2 = 0;
+	}
+	return 1;
+}
+
+
+/**
+ * Restore the clip rectangle and origin saved by the last st_push_clip()
+ * @param disp display
+ */
+void st_pop_clip(st_display_t *disp)
+{
+	if (disp->clip_depth == 0)
+		return;
+
+	const st_clip_t *saved = &disp->clip_stack[--disp->clip_depth];
+	disp->clip_x1 = saved->x1;
+	disp->clip_y1 = saved->y1;
+	disp->clip_x2 = saved->x2;
+	disp->clip_y2 = saved->y2;
+	disp->origin_x = saved->origin_x;
+	disp->origin_y = saved->origin_y;
+}
+
+
+/**
+ * Move the origin, the point drawn at (0,0), to (x,y) of the current drawing coordinates.
+ * Usually called after st_push_clip() with the same x and y, so a widget draws at (0,0).
+ * @param disp display
+ * @param x column of the new origin, relative to the current one
+ * @param y row of the new origin, relative to the current one
+ */
+void st_set_origin(st_display_t *disp, int16_t x, int16_t y)
+{
+	disp->origin_x += x;
+	disp->origin_y += y;
+}
+
+
+/**
+ * Set an area for drawing on the display with start row,col and end row,col.
+ * User don't need to call it usually, call it only before some functions who don't call it by default.
+ * @param disp display
+ * @param x1 start column address.
+ * @param y1 start row address.
+ * @param x2 end column address.
+ * @param y2 end row address.
+ */
+void st_set_address_window(st_display_t *disp, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	#ifdef ST_USE_DISPLAY_LIST
+		// Window cache below must already include the recorded list
+		if (disp->dlist_recording)
+			_st_dlist_send(disp);
+	#endif
+
+	// Window is already set, and the write pointer is back at its start
+	if (disp->win_valid && x1 == disp->win_x1 && x2 == disp->win_x2 && y1 == disp->win_y1 && y2 == disp->win_y2 &&
+		disp->win_ramwr_open && disp->win_written == 0)
+		return;
+
+	_st_set_window(disp, x1, y1, x2, y2);
+	st_queue_command(disp, ST7789_RAMWR, NULL, 0);
+}
+
+
+/*
+ * Queue CASET and RASET for the window, skipping the ones that wouldn't change anything
+ */
+static void _st_set_window(st_display_t *disp, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	uint8_t params[4];
+	uint8_t same_x = disp->win_valid && x1 == disp->win_x1 && x2 == disp->win_x2;
+	uint8_t same_y = disp->win_valid && y1 == disp->win_y1 && y2 == disp->win_y2;
+
+	if (!same_x)
+	{
+		params[0] = (uint8_t)(x1 >> 8);
+		params[1] = (uint8_t)x1;
+		params[2] = (uint8_t)(x2 >> 8);
+		params[3] = (uint8_t)x2;
+		st_queue_command(disp, ST7789_CASET, params, 4);
+	}
+
+	if (!same_y)
+	{
+		params[0] = (uint8_t)(y1 >> 8);
+		params[1] = (uint8_t)y1;
+		params[2] = (uint8_t)(y2 >> 8);
+		params[3] = (uint8_t)y2;
+		st_queue_command(disp, ST7789_RASET, params, 4);
+	}
+
+	disp->win_valid = 1;
+}
+
+
+
+/*
+ * Find the glyph of character `code` in `font`, NULL if the font doesn't have it.
+ * Fonts made by the converter are sorted by code, and most are one dense range (like ASCII 0x20 -
+ * 0x7E). There the glyph of `code` is at index `code - first code`, found with one compare.
+ * Sparse fonts are binary searched. Only characters missing from a sorted font (or any character
+ * of an unsorted one) take a linear scan.
+ */
+static const tImage *_st_find_glyph(const tFont *font, long code)
+{
+	const tChar *chars = font->chars;
+	int n = font->length;
+	if (n <= 0)
+		return NULL;
+
+	// Dense range
+	long i = code - chars[0].code;
+	if (i >= 0 && i < n && chars[i].code == code)
+		return chars[i].image;
+
+	// Sorted codes
+	int lo = 0, hi = n - 1;
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (chars[mid].code == code)
+			return chars[mid].image;
+		if (chars[mid].code < code)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	for (int j = 0; j < n; j++)
+		if (chars[j].code == code)
+			return chars[j].image;
+	return NULL;
+}
+
+
+/*
+ * Set MADCTL to `madctl` unless it's set already
+ */
+static void _st_set_madctl(st_display_t *disp, uint8_t madctl)
+{
+	if (disp->madctl != madctl)
+		st_queue_command(disp, ST7789_MADCTL, &madctl, 1);
+}
+
+
+#ifdef ST_USE_GLYPH_CACHE
+
+/*
+ * Cached glyphs are queued straight from the cache buffer, so their pixels can't be overwritten
+ * until they're sent. Every text drawing them ends with a fence (a queued callback), and each
+ * entry remembers the fence after its last use.
+ */
+static void _st_gcache_release(void *arg)
+{
+	st_display_t *disp = (st_display_t *)arg;
+	disp->gcache_passed++;
+}
+
+/*
+ * Queue a fence after the cached glyphs queued since the last one
+ */
+static void _st_gcache_fence(st_display_t *disp)
+{
+	if (disp->gcache_open)
+	{
+		disp->gcache_open = 0;
+		disp->gcache_fences++;
+		st_queue_callback(disp, _st_gcache_release, disp);
+	}
+}
+
+/*
+ * Drop a cached glyph, waiting until its pixels are sent
+ */
+static void _st_gcache_evict(st_display_t *disp, st_glyph_entry_t *entry)
+{
+	if (entry->fence == (uint16_t)(disp->gcache_fences + 1))
+		_st_gcache_fence(disp);		// used by the text being drawn
+	while ((int16_t)(disp->gcache_passed - entry->fence) < 0);
+
+	entry->glyph = NULL;
+	disp->gcache_stats.evictions++;
+}
+
+/*
+ * Get a free entry with room for `len` pixels (first fit), evicting the least recently drawn
+ * glyphs until there is one
+ * @return the entry with its offset set, NULL if `len` is bigger than the buffer
+ */
+static st_glyph_entry_t *_st_gcache_alloc(st_display_t *disp, uint32_t len)
+{
+	st_glyph_entry_t *entries = disp->gcache_entries;
+	if (len > disp->gcache_len)
+		return NULL;
+
+	while (1)
+	{
+		st_glyph_entry_t *free_entry = NULL, *oldest = NULL;
+		for (uint8_t i = 0; i < ST_GLYPH_CACHE_ENTRIES; i++)
+		{
+			if (entries[i].glyph == NULL)
+			{
+				if (free_entry == NULL)
+					free_entry = &entries[i];
+			}
+			else if (oldest == NULL || (int32_t)(entries[i].used - oldest->used) < 0)
+			{
+				oldest = &entries[i];
+			}
+		}
+
+		if (free_entry)
+		{
+			// Room starts at the beginning of the buffer or right after a cached glyph
+			for (int16_t i = -1; i < ST_GLYPH_CACHE_ENTRIES; i++)
+			{
+				uint32_t start = 0;
+				if (i >= 0)
+				{
+					if (entries[i].glyph == NULL)
+						continue;
+					start = entries[i].offset + (uint32_t)entries[i].glyph->width * entries[i].glyph->height;
+				}
+				if (start + len > disp->gcache_len)
+					continue;
+
+				uint8_t j;
+				for (j = 0; j < ST_GLYPH_CACHE_ENTRIES; j++)
+				{
+					const st_glyph_entry_t *e = &entries[j];
+					if (e->glyph && start < e->offset + (uint32_t)e->glyph->width * e->glyph->height &&
+						e->offset < start + len)
+						break;
+				}
+				if (j == ST_GLYPH_CACHE_ENTRIES)
+				{
+					free_entry->offset = start;
+					return free_entry;
+				}
+			}
+		}
+
+		// With nothing cached, the buffer is all free, so there is an oldest glyph here
+		_st_gcache_evict(disp, oldest);
+	}
+}
+
+/*
+ * Expand a whole glyph column by column, as _st_render_glyph_opaque() sends it
+ */
+static void _st_gcache_expand(uint16_t *buf, const tImage *glyph, uint16_t fore_color, uint16_t back_color)
+{
+	uint8_t size = glyph->dataSize;
+	uint16_t col_bytes = (glyph->height + size - 1) / size;
+	uint8_t last_mask = 0x80 >> (size - 1);
+
+	for (uint16_t c = 0; c < glyph->width; c++)
+	{
+		const uint8_t *p = glyph->data + (uint32_t)c * col_bytes;
+		uint8_t mask = 0x80;
+		for (uint16_t r = 0; r < glyph->height; r++)
+		{
+			*buf++ = (*p & mask) ? back_color : fore_color;
+			if (mask == last_mask)
+			{
+				p++;
+				mask = 0x80;
+			}
+			else
+			{
+				mask >>= 1;
+			}
+		}
+	}
+}
+
+/*
+ * Get the pixels of a glyph in these colors from the cache, expanding it there if it's not cached.
+ * The pixels must be queued before the text's fence.
+ * @return the pixels, NULL if the glyph doesn't fit in the cache
+ */
+static const uint16_t *_st_gcache_get(st_display_t *disp, const tImage *glyph, uint16_t fore_color, uint16_t back_color)
+{
+	st_glyph_entry_t *entry = NULL;
+	for (uint8_t i = 0; i < ST_GLYPH_CACHE_ENTRIES; i++)
+	{
+		st_glyph_entry_t *e = &disp->gcache_entries[i];
+		if (e->glyph == glyph && e->fore_color == fore_color && e->back_color == back_color)
+		{
+			entry = e;
+			break;
+		}
+	}
+
+	if (entry)
+	{
+		disp->gcache_stats.hits++;
+	}
+	else
+	{
+		disp->gcache_stats.misses++;
+		entry = _st_gcache_alloc(disp, (uint32_t)glyph->width * glyph->height);
+		if (entry == NULL)
+			return NULL;
+		_st_gcache_expand(disp->gcache + entry->offset, glyph, fore_color, back_color);
+		entry->glyph = glyph;
+		entry->fore_color = fore_color;
+		entry->back_color = back_color;
+	}
+
+	entry->used = ++disp->gcache_clock;
+	entry->fence = disp->gcache_fences + 1;
+	disp->gcache_open = 1;
+	return disp->gcache + entry->offset;
+}
+
+
+/**
+ * Keep glyphs of text with background expanded in `buffer`. A glyph drawn again with the same font,
+ * character and colors is sent from it by DMA, without expanding its bitmap. When the buffer or
+ * the entries (ST_GLYPH_CACHE_ENTRIES) are full, the least recently drawn glyphs are evicted.
+ * Glyphs only partly inside the clip rectangle are not cached. Statistics are cleared.
+ * @param disp display
+ * @param buffer RGB565 pixels, width x height of each cached glyph (800 for a 20x40 glyph),
+ * NULL to stop caching
+ * @param len size of `buffer` in pixels
+ */
+void st_set_glyph_cache(st_display_t *disp, uint16_t *buffer, uint16_t len)
+{
+	// Queued glyphs may still be read from the old buffer
+	st_wait_idle(disp);
+
+	disp->gcache = buffer;
+	disp->gcache_len = buffer ? len : 0;
+	for (uint8_t i = 0; i < ST_GLYPH_CACHE_ENTRIES; i++)
+		disp->gcache_entries[i].glyph = NULL;
+	disp->gcache_clock = 0;
+	disp->gcache_fences = 0;
+	disp->gcache_passed = 0;
+	disp->gcache_open = 0;
+	disp->gcache_stats = (st_glyph_cache_stats_t){0, 0, 0};
+}
+
+
+/**
+ * Get the glyph cache hits, misses and evictions since st_set_glyph_cache(). Few misses
+ * once the screen is drawn mean the buffer is big enough.
+ * @param disp display
+ * @return statistics
+ */
+st_glyph_cache_stats_t st_get_glyph_cache_stats(st_display_t *disp)
+{
+	return disp->gcache_stats;
+}
+
+#endif
+
+
+/*
+ * Render a glyph with its background: the visible part is one address window, filled with the
+ * glyph expanded to RGB565 in pixel staging buffer chunks. A chunk is expanded while the one
+ * before it (maybe of the previous glyph) is still being sent.
+ * Glyphs are stored column by column, so rows and columns are exchanged (MV of `madctl`, the
+ * MADCTL of the rotation, is flipped) and RAMWR fills the window down each column: the bitmap is
+ * read in order, with no addressing per pixel. The caller sets `madctl` again after the text.
+ */
+static void _st_render_glyph_opaque(st_display_t *disp, int16_t x, int16_t y, uint16_t fore_color, uint16_t back_color, const tImage *glyph, uint8_t madctl)
+{
+	int16_t x1 = x, y1 = y;
+	int16_t x2 = x + glyph->width - 1, y2 = y + glyph->height - 1;
+	if (glyph->width == 0 || glyph->height == 0 || !_st_clip(disp, &x1, &y1, &x2, &y2))
+		return;
+
+	uint16_t h = y2 - y1 + 1;
+	uint32_t n = (uint32_t)(x2 - x1 + 1) * h;
+	uint16_t col = x1 - (x + disp->origin_x);
+	uint16_t row = y1 - (y + disp->origin_y);
+	// Every column starts with a new byte, each byte holds `dataSize` rows (set bits are background)
+	uint8_t size = glyph->dataSize;
+	uint16_t col_bytes = (glyph->height + size - 1) / size;
+	uint8_t last_mask = 0x80 >> (size - 1);
+	const uint8_t *first = glyph->data + (uint32_t)col * col_bytes + row / size;
+	uint8_t first_mask = 0x80 >> (row % size);
+
+	// With MV flipped, the controller's columns are screen rows and its rows are screen columns
+	_st_set_madctl(disp, madctl ^ ST7789_MADCTL_MV);
+	st_set_address_window(disp, y1, x1, y2, x2);
+
+	#ifdef ST_USE_GLYPH_CACHE
+		// A whole glyph is sent from the cache in one transfer
+		if (disp->gcache && n == (uint32_t)glyph->width * glyph->height)
+		{
+			const uint16_t *pixels = _st_gcache_get(disp, glyph, fore_color, back_color);
+			if (pixels)
+			{
+				st_queue_data16(disp, pixels, n);
+				return;
+			}
+		}
+	#endif
+
+	const uint8_t *p = first;
+	uint8_t mask = first_mask;
+	uint16_t r = 0;
+	while (n)
+	{
+		uint16_t len = (n < ST_PIXBUF_LEN / 2) ? n : ST_PIXBUF_LEN / 2;
+		uint16_t *buf = _st_pixbuf_get(disp, len);
+
+		for (uint16_t i = 0; i < len; i++)
+		{
+			buf[i] = (*p & mask) ? back_color : fore_color;
+			if (++r == h)
+			{
+				// Next column
+				r = 0;
+				first += col_bytes;
+				p = first;
+				mask = first_mask;
+			}
+			else if (mask == last_mask)
+			{
+				p++;
+				mask = 0x80;
+			}
+			else
+			{
+				mask >>= 1;
+			}
+		}
+
+		st_queue_data16(disp, buf, len);
+		n -= len;
+	}
+}
+
+
+/*
+ * Transparent glyphs are sent as rectangles of foreground. Vertical runs are found in each column,
+ * and a run with the same rows as one in the column before grows that rectangle instead.
+ */
+#define ST_GLYPH_RUNS		16		// max runs per column joined with the next column
+
+typedef struct
+{
+	uint16_t x;						// first column of the rectangle
+	uint16_t y1, y2;
+} st_glyph_run_t;
+
+/*
+ * Render a glyph without background as filled rectangles
+ */
+static void _st_render_glyph_runs(st_display_t *disp, int16_t x, int16_t y, uint16_t fore_color, const tImage *glyph)
+{
+	uint8_t size = glyph->dataSize;
+	uint16_t col_bytes = (glyph->height + size - 1) / size;
+	uint8_t last_mask = 0x80 >> (size - 1);
+	st_glyph_run_t open[ST_GLYPH_RUNS], runs[ST_GLYPH_RUNS];
+	uint8_t n_open = 0;
+
+	for (uint16_t c = 0; c <= glyph->width; c++)
+	{
+		// Runs of this column, top to bottom. The ones that don't fit are sent 1 column wide.
+		uint8_t n = 0;
+		if (c < glyph->width)
+		{
+			const uint8_t *p = glyph->data + (uint32_t)c * col_bytes;
+			uint8_t mask = 0x80;
+			int16_t start = -1;
+			for (uint16_t r = 0; r <= glyph->height; r++)
+			{
+				uint8_t on = r < glyph->height && !(*p & mask);	// clear bits are foreground
+				if (on && start < 0)
+					start = r;
+				else if (!on && start >= 0)
+				{
+					if (n < ST_GLYPH_RUNS)
+						runs[n++] = (st_glyph_run_t){c, start, r - 1};
+					else
+						_st_fill_area(disp, x + c, y + start, x + c, y + r - 1, fore_color);
+					start = -1;
+				}
+
+				if (mask == last_mask)
+				{
+					p++;
+					mask = 0x80;
+				}
+				else
+				{
+					mask >>= 1;
+				}
+			}
+		}
+
+		// Rectangles not continued by a run of this column are complete
+		uint8_t k = 0;
+		for (uint8_t i = 0; i < n_open; i++)
+		{
+			while (k < n && runs[k].y1 < open[i].y1)
+				k++;
+			if (k < n && runs[k].y1 == open[i].y1 && runs[k].y2 == open[i].y2)
+				runs[k].x = open[i].x;
+			else
+				_st_fill_area(disp, x + open[i].x, y + open[i].y1, x + c - 1, y + open[i].y2, fore_color);
+		}
+		for (uint8_t i = 0; i < n; i++)
+			open[i] = runs[i];
+		n_open = n;
+	}
+}
+
+
+/*
+ * Render a character glyph on the display. Called by `_st_draw_string_main()`
+ * User need NOT call it
+ */
+void _st_render_glyph(st_display_t *disp, uint16_t x, uint16_t y, uint16_t fore_color, uint16_t back_color, const tImage *glyph, uint8_t is_bg)
+{
+	if (is_bg)
+	{
+		uint8_t madctl = disp->madctl;
+		_st_render_glyph_opaque(disp, x, y, fore_color, back_color, glyph, madctl);
+		_st_set_madctl(disp, madctl);
+		#ifdef ST_USE_GLYPH_CACHE
+			_st_gcache_fence(disp);
+		#endif
+		return;
+	}
+
+	_st_render_glyph_runs(disp, x, y, fore_color, glyph);
+}
+
+
+
+/**
+ * Renders a string by drawing each character glyph from the passed string.
+ * Called by `st_draw_string()` and `st_draw_string_withbg()`.
+ * Text is wrapped automatically if it hits the screen boundary.
+ * x_padding and y_padding defines horizontal and vertical distance (in px) between two characters
+ * is_bg=1 : Text will habe background color,   is_bg=0 : Text will have transparent background
+ * User need NOT call it.
+ */
+
+void _st_draw_string_main(st_display_t *disp, uint16_t x, uint16_t y, char *str, uint16_t fore_color, uint16_t back_color, const tFont *font, uint8_t is_bg)
+{
+	uint16_t x_temp = x;
+	uint16_t y_temp = y;
+
+	uint8_t x_padding = 0;
+	uint8_t y_padding = 0;
+	const tImage *img = NULL;
+	uint16_t width = 0, height = 0;
+	uint8_t madctl = disp->madctl;		// opaque glyphs change it (see _st_render_glyph_opaque())
+
+
+	while (*str)
+	{
+		if (*str == '\n')
+		{
+			x_temp = x;					//go to first col
+			y_temp += (font->chars[0].image->height + y_padding);	//go to next row (row height = height of space)
+		}
+
+		else if (*str == '\t')
+		{
+			x_temp += 4 * (font->chars[0].image->height + y_padding);	//Skip 4 spaces (width = width of space)
+		}
+		else
+		{
+			img = _st_find_glyph(font, (unsigned char)*str);
+			// No glyph (img) found, so stop here
+			if (img == NULL)
+			{
+				break;
+			}
+
+			width = img->width;
+			height = img->height;
+
+			if (y_temp + disp->origin_y + (height + y_padding) > disp->height - 1)	//not enough space available at the bottom of the screen
+				break;
+			if (x_temp + disp->origin_x + (width + x_padding) > disp->width - 1)	//not enough space available at the right side of the screen
+			{
+				x_temp = x;					//go to first col
+				y_temp += (height + y_padding);	//go to next row
+			}
+
+
+			if (is_bg)
+				_st_render_glyph_opaque(disp, x_temp, y_temp, fore_color, back_color, img, madctl);
+			else
+				_st_render_glyph(disp, x_temp, y_temp, fore_color, back_color, img, 0);
+			x_temp += (width + x_padding);		//next char position
+		}
+
+
+		str++;
+	}
+
+	_st_set_madctl(disp, madctl);
+	#ifdef ST_USE_GLYPH_CACHE
+		_st_gcache_fence(disp);
+	#endif
+}
+
+
+/**
+ * Draws a character at a given position, fore color, back color.
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ * @param character the ASCII character to be drawn
+ * @param fore_color foreground color
+ * @param back_color background color
+ * @param font Pointer to the font of the character
+ * @param is_bg Defines if character has background or not (transparent)
+ */
+void st_draw_char(st_display_t *disp, uint16_t x, uint16_t y, char character, uint16_t fore_color, uint16_t back_color, const tFont *font, uint8_t is_bg)
+{
+	const tImage *img = _st_find_glyph(font, (unsigned char)character);
+	// No glyph (img) found, so return from this function
+	if (img == NULL)
+	{
+		return;
+	}
+
+	if (is_bg)
+		_st_render_glyph(disp, x, y, fore_color, back_color, img, 1);
+	else
+		_st_render_glyph(disp, x, y, fore_color, back_color, img, 0);
+}
+
+
+/**
+ * Draws a string on the display with `font` and `color` at given position.
+ * Background of this string is transparent. Each column of a glyph is sent as runs of
+ * foreground, and runs repeated in the next columns as one rectangle.
+ * @param disp display
+ * @param x Start col address
+ * @param y Start y address
+ * @param str pointer to the string to be drawn
+ * @param color 16-bit RGB565 color of the string
+ * @param font Pointer to the font of the string
+ */
+void st_draw_string(st_display_t *disp, uint16_t x, uint16_t y, char *str, uint16_t color, const tFont *font)
+{
+	_st_draw_string_main(disp, x, y, str, color, 0, font, 0);
+}
+
+
+/**
+ * Draws a string on the display with `font`, `fore_color`, and `back_color` at given position.
+ * The string has background color. Each character is sent as one window of pixels, column by
+ * column as glyphs are stored (MADCTL MV is flipped while the string is drawn).
+ * Glyphs in the glyph cache are sent from it (see st_set_glyph_cache()).
+ * @param disp display
+ * @param x Start col address
+ * @param y Start y address
+ * @param str pointer to the string to be drawn
+ * @param foe_color 16-bit RGB565 color of the string
+ * @param back_color 16-bit RGB565 color of the string's background
+ * @param font Pointer to the font of the string
+ */
+void st_draw_string_withbg(st_display_t *disp, uint16_t x, uint16_t y, char *str, uint16_t fore_color, uint16_t back_color, const tFont *font)
+{
+	_st_draw_string_main(disp, x, y, str, fore_color, back_color, font, 1);
+}
+
+
+/*
+ * Draw the visible part of an image of 2 bytes per pixel. `is_16bit` is 1 for native uint16_t pixels
+ * (tImage16bit), 0 for big-endian bytes (tImage). If columns are clipped, rows are not contiguous
+ * in the image, so each row is a separate transfer (in the same window).
+ */
+static void _st_draw_image(st_display_t *disp, int16_t x, int16_t y, uint16_t width, uint16_t height, const void *data, uint8_t is_16bit)
+{
+	int16_t x1 = x, y1 = y;
+	int16_t x2 = x + width - 1, y2 = y + height - 1;
+	if (width == 0 || height == 0 || !_st_clip(disp, &x1, &y1, &x2, &y2))
+		return;
+
+	uint16_t w = x2 - x1 + 1;
+	uint16_t h = y2 - y1 + 1;
+	uint16_t skip_x = x1 - (x + disp->origin_x);
+	uint16_t skip_y = y1 - (y + disp->origin_y);
+	const uint8_t *p = (const uint8_t *)data + ((uint32_t)skip_y * width + skip_x) * 2;
+
+	uint16_t parts = (w == width) ? 1 : h;
+	uint16_t part_h = (w == width) ? h : 1;
+
+	#ifdef ST_USE_DISPLAY_LIST
+		if (disp->dlist_recording)
+		{
+			for (uint16_t i = 0; i < parts; i++)
+			{
+				_st_dlist_add(disp, x1, y1 + i, w, part_h, 0, is_16bit ? ST_DL_BITMAP16 : ST_DL_BITMAP, p);
+				p += (uint32_t)width * 2;
+			}
+			return;
+		}
+	#endif
+
+	st_set_address_window(disp, x1, y1, x2, y2);
+	for (uint16_t i = 0; i < parts; i++)
+	{
+		if (is_16bit)
+			st_queue_data16(disp, (const uint16_t *)p, (uint32_t)w * part_h);
+		else
+			st_queue_data(disp, p, (uint32_t)w * part_h * 2);
+		p += (uint32_t)width * 2;
+	}
+}
+
+
+/**
+ * Draw a bitmap image on the display
+ * @param x Start col address
+ * @param y Start row address
+ * @param bitmap Pointer to the image data to be drawn
+ */
+
+void st_draw_bitmap(st_display_t *disp, uint16_t x, uint16_t y, const tImage *bitmap)
+{
+	_st_draw_image(disp, x, y, bitmap->width, bitmap->height, bitmap->data, 0);
+}
+
+
+/**
+ * Draw a 16-bit bitmap image on the display.
+ * Pixels are sent as 16-bit SPI frames straight from `bitmap->data`.
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ * @param bitmap Pointer to the image data to be drawn
+ */
+void st_draw_bitmap_16bit(st_display_t *disp, uint16_t x, uint16_t y, const tImage16bit *bitmap)
+{
+	_st_draw_image(disp, x, y, bitmap->width, bitmap->height, bitmap->data, 1);
+}
+
+
+/**
+ * Fills `len` number of pixels with `color`.
+ * Call st_set_address_window() before calling this function.
+ * @param color 16-bit RGB565 color value
+ * @param len 32-bit number of pixels
+ */
+
+void st_fill_color(st_display_t *disp, uint16_t color, uint32_t len)
+{
+	st_queue_fill(disp, color, len);
+}
+
+
+/**
+ * Fills a rectangular area with `color`.
+ * Before filling, performs area bound checking
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ * @param w Width of rectangle
+ * @param h Height of rectangle
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+{
+	if (w == 0 || h == 0)
+		return;
+	_st_fill_area(disp, x, y, x + w - 1, y + h - 1, color);
+}
+
+
+/*
+ * Same as `st_fill_rect()`. Clipping is always done now, it's kept for compatibility.
+ */
+void st_fill_rect_fast(st_display_t *disp, uint16_t x1, uint16_t y1, uint16_t w, uint16_t h, uint16_t color)
+{
+	st_fill_rect(disp, x1, y1, w, h, color);
+}
+
+
+/**
+ * Fill the entire display (screen) with `color`. Only the clip rectangle is filled, if there is one.
+ * @param disp display
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_screen(st_display_t *disp, uint16_t color)
+{
+	if (disp->clip_x1 <= disp->clip_x2 && disp->clip_y1 <= disp->clip_y2)
+		_st_draw_rect(disp, disp->clip_x1, disp->clip_y1, disp->clip_x2 - disp->clip_x1 + 1, disp->clip_y2 - disp->clip_y1 + 1, color);
+}
+
+
+/**
+ * Draw a rectangle
+*/
+void st_draw_rectangle(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+{
+	if (w == 0 || h == 0)
+		return;
+
+	_st_draw_fast_h_line(disp, x, y, x+w-1, 1, color);
+	_st_draw_fast_h_line(disp, x, y+h, x+w-1, 1, color);
+	_st_draw_fast_v_line(disp, x, y, y+h-1, 1, color);
+	_st_draw_fast_v_line(disp, x+w, y, y+h-1, 1, color);
+
+
+}
+
+/*
+ * Bresenham walk of a line along its major axis, one run (points with the same minor coordinate) at a time
+ */
+typedef struct
+{
+	int32_t major;		// major coordinate of the next point
+	int32_t end;		// last major coordinate of the line
+	int32_t d_major;	// up to 65535 for a line across the whole int16_t range
+	int32_t d_minor;
+	int32_t D;
+} st_line_walk_t;
+
+static void _st_line_walk_init(st_line_walk_t *walk, int16_t major0, int16_t major1, int32_t d_minor)
+{
+	walk->major = major0;
+	walk->end = major1;
+	walk->d_major = (int32_t)major1 - major0;
+	walk->d_minor = d_minor;
+	walk->D = 2*d_minor - walk->d_major;
+}
+
+/*
+ * Move a walk that hasn't been run yet forward to major coordinate `major`, without visiting the
+ * points in between. Returns how many times the minor coordinate stepped on the way.
+ */
+static int32_t _st_line_walk_skip(st_line_walk_t *walk, int32_t major)
+{
+	int64_t k = major - walk->major;
+	int32_t steps = (walk->d_major > 0) ? (2*walk->d_minor*k + walk->d_major - 1) / (2*walk->d_major) : 0;
+
+	walk->major = major;
+	walk->D += 2*walk->d_minor*k - 2*(int64_t)walk->d_major*steps;
+	return steps;
+}
+
+/*
+ * Get the first and last major coordinates of the next run
+ */
+static void _st_line_walk_run(st_line_walk_t *walk, int16_t *start, int16_t *stop)
+{
+	uint8_t step;
+
+	*start = walk->major;
+	do
+	{
+		step = walk->D > 0;
+		if (step)
+			walk->D -= 2*walk->d_major;
+		walk->D += 2*walk->d_minor;
+		walk->major++;
+	} while (!step && walk->major <= walk->end);
+	*stop = walk->major - 1;
+}
+
+/*
+ * Fill a rectangle given in (major, minor) coordinates
+ */
+static void _st_line_span(st_display_t *disp, uint8_t steep, int16_t major1, int16_t major2, int16_t minor1, int16_t minor2, uint16_t color)
+{
+	if (steep)
+		_st_fill_area(disp, minor1, major1, minor2, major2, color);
+	else
+		_st_fill_area(disp, major1, minor1, major2, minor2, color);
+}
+
+/*
+ * Draw the line as the union of `width` x `width` squares at its Bresenham points (square at the
+ * top-left corner), without drawing any pixel twice. Squares of a run of points form one span. A row
+ * (or column, if steep) of the thick line is covered by at most `width` consecutive runs, so it is a
+ * single span from the start of the first of them to the end of the last. Identical spans on adjacent
+ * rows are merged into one rectangle.
+ */
+static void _st_plot_line(st_display_t *disp, int16_t major0, int16_t minor0, int16_t major1, int16_t minor1, uint8_t width, uint16_t color, uint8_t steep)
+{
+	if (width == 0)
+		return;
+
+	int16_t d_minor = minor1 - minor0;
+	int8_t step = 1;
+	if (d_minor < 0)
+	{
+		step = -1;
+		d_minor = -d_minor;
+	}
+
+	// Runs are walked twice: `head` is the last run covering the current row, `tail` the first one
+	st_line_walk_t head, tail;
+	_st_line_walk_init(&head, major0, major1, d_minor);
+	_st_line_walk_init(&tail, major0, major1, d_minor);
+
+	int16_t n_runs = d_minor + 1;
+	int16_t head_start = 0, head_stop = 0, tail_start, tail_stop;
+	int16_t rect_major1 = 0, rect_major2 = 0, rect_minor1 = 0, rect_minor2 = 0;
+	uint8_t rect_open = 0;
+
+	_st_line_walk_run(&tail, &tail_start, &tail_stop);
+
+	// Rows go in the direction of the runs, from the first run's top row to the last run's bottom row
+	for (int16_t i = 0; i < n_runs + width - 1; i++)
+	{
+		if (i < n_runs)
+			_st_line_walk_run(&head, &head_start, &head_stop);
+		if (i >= width)
+			_st_line_walk_run(&tail, &tail_start, &tail_stop);
+
+		int16_t row = (step > 0) ? minor0 + i : minor0 + width - 1 - i;
+		int16_t span1 = tail_start;
+		int16_t span2 = head_stop + width - 1;
+
+		if (rect_open && span1 == rect_major1 && span2 == rect_major2)
+		{
+			if (row < rect_minor1)
+				rect_minor1 = row;
+			else
+				rect_minor2 = row;
+			continue;
+		}
+
+		if (rect_open)
+			_st_line_span(disp, steep, rect_major1, rect_major2, rect_minor1, rect_minor2, color);
+		rect_major1 = span1;
+		rect_major2 = span2;
+		rect_minor1 = rect_minor2 = row;
+		rect_open = 1;
+	}
+
+	_st_line_span(disp, steep, rect_major1, rect_major2, rect_minor1, rect_minor2, color);
+}
+
+
+/*
+ * Called by st_draw_line().
+ * User need not call it
+ */
+void _st_plot_line_low(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color)
+{
+	_st_plot_line(disp, x0, y0, x1, y1, width, color, 0);
+}
+
+
+/*
+ * Called by st_draw_line().
+ * User need not call it
+ */
+void _st_plot_line_high(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color)
+{
+	_st_plot_line(disp, y0, x0, y1, x1, width, color, 1);
+}
+
+
+/**
+ * Draw a line from (x0,y0) to (x1,y1) with `width` and `color`.
+ * @param disp display
+ * @param x0 start column address.
+ * @param y0 start row address.
+ * @param x1 end column address.
+ * @param y1 end row address.
+ * @param width width or thickness of the line
+ * @param color 16-bit RGB565 color of the line
+ */
+void st_draw_line(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color)
+{
+	/*
+	* Brehensen's algorithm is used.
+	* Not necessarily start points has to be less than end points.
+	*/
+
+	if (x0 == x1)	//vertical line
+	{
+		_st_draw_fast_v_line(disp, x0, y0, y1, width, color);
+	}
+	else if (y0 == y1)		//horizontal line
+	{
+		_st_draw_fast_h_line(disp, x0, y0, x1, width, color);
+	}
+
+	else
+	{
+		if (abs(y1 - y0) < abs(x1 - x0))
+		{
+			if (x0 > x1)
+				_st_plot_line_low(disp, x1, y1, x0, y0, width, color);
+			else
+				_st_plot_line_low(disp, x0, y0, x1, y1, width, color);
+		}
+
+		else
+		{
+			if (y0 > y1)
+				_st_plot_line_high(disp, x1, y1, x0, y0, width, color);
+			else
+				_st_plot_line_high(disp, x0, y0, x1, y1, width, color) ;
+		}
+	}
+
+}
+
+
+/*
+ * Called by st_draw_line().
+ * User need not call it
+ */
+void _st_draw_fast_h_line(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint8_t width, uint16_t color)
+{
+	/*
+	* Draw a horizontal line very fast
+	*/
+	if (width == 0)
+		return;
+	if (x0 < x1)
+		_st_fill_area(disp, x0, y0, x1, y0 + width - 1, color);	//as it's horizontal line, y1=y0.. must be.
+	else
+		_st_fill_area(disp, x1, y0, x0, y0 + width - 1, color);
+}
+
+
+/*
+ * Called by st_draw_line().
+ * User need not call it
+ */
+void _st_draw_fast_v_line(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t y1, uint8_t width, uint16_t color)
+{
+	/*
+	* Draw a vertical line very fast
+	*/
+	if (width == 0)
+		return;
+	if (y0 < y1)
+		_st_fill_area(disp, x0, y0, x0 + width - 1, y1, color);	//as it's vertical line, x1=x0.. must be.
+	else
+		_st_fill_area(disp, x0, y1, x0 + width - 1, y0, color);
+}
+
+
+/**
+ * Draw a pixel at a given position with `color`
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ */
+void st_draw_pixel(st_display_t *disp, uint16_t x, uint16_t y, uint16_t color)
+{
+	/*
+	* Why?: This function is mainly added in the driver so that  ui libraries can use it.
+	* example: LittlevGL requires user to supply a function that can draw pixel
+	*/
+
+	_st_fill_area(disp, x, y, x, y, color);
+}
+
+
+/*
+ * Draw a batch of pixels. Used by st_draw_pixels() and st_draw_pixels_color().
+ * Visible points are sorted by row and column, and horizontally adjacent ones are sent as one run.
+ * Rows are kept together, so the window cache skips RASET between pixels of a row.
+ */
+static void _st_draw_pixels(st_display_t *disp, const st_point_t *points, const uint16_t *colors, uint16_t color, uint16_t n)
+{
+	// Sort key: screen row (bits 17-25), screen column (bits 8-16), index in the batch (bits 0-7)
+	uint32_t keys[ST_PIXELS_BATCH];
+
+	while (n)
+	{
+		uint16_t batch = n < ST_PIXELS_BATCH ? n : ST_PIXELS_BATCH;
+		uint16_t m = 0;
+
+		for (uint16_t i = 0; i < batch; i++)
+		{
+			int32_t x = (int32_t)points[i].x + disp->origin_x;
+			int32_t y = (int32_t)points[i].y + disp->origin_y;
+			if (x >= disp->clip_x1 && x <= disp->clip_x2 && y >= disp->clip_y1 && y <= disp->clip_y2)
+				keys[m++] = ((uint32_t)y << 17) | ((uint32_t)x << 8) | i;
+		}
+
+		// Shell sort. Equal points keep their order (by index), so the last one wins below.
+		static const uint8_t gaps[] = {57, 23, 10, 4, 1};
+		for (uint8_t g = 0; g < sizeof(gaps); g++)
+		{
+			uint8_t gap = gaps[g];
+			for (uint16_t i = gap; i < m; i++)
+			{
+				uint32_t key = keys[i];
+				uint16_t j = i;
+				while (j >= gap && keys[j - gap] > key)
+				{
+					keys[j] = keys[j - gap];
+					j -= gap;
+				}
+				keys[j] = key;
+			}
+		}
+
+		uint16_t i = 0;
+		while (i < m)
+		{
+			// Find the run: same row, next column (or the same point again)
+			uint16_t x1 = (keys[i] >> 8) & 0x1FF;
+			uint16_t y = keys[i] >> 17;
+			uint16_t x2 = x1;
+			uint16_t end = i + 1;
+			uint8_t one_color = 1;
+			while (end < m && (keys[end] >> 17) == y && ((keys[end] >> 8) & 0x1FF) <= (uint32_t)x2 + 1)
+			{
+				x2 = (keys[end] >> 8) & 0x1FF;
+				if (colors && colors[keys[end] & 0xFF] != colors[keys[i] & 0xFF])
+					one_color = 0;
+				end++;
+			}
+
+			if (one_color)
+			{
+				_st_draw_rect(disp, x1, y, x2 - x1 + 1, 1, colors ? colors[keys[i] & 0xFF] : color);
+			}
+			else
+			{
+				st_set_address_window(disp, x1, y, x2, y);
+				uint16_t *buf = _st_pixbuf_get(disp, x2 - x1 + 1);
+				for (uint16_t k = i; k < end; k++)
+					buf[((keys[k] >> 8) & 0x1FF) - x1] = colors[keys[k] & 0xFF];
+				st_queue_data16(disp, buf, x2 - x1 + 1);
+			}
+			i = end;
+		}
+
+		points += batch;
+		if (colors)
+			colors += batch;
+		n -= batch;
+	}
+}
+
+
+/**
+ * Draw many pixels, each with its own color. Much faster than calling st_draw_pixel() for each.
+ * Pixels are sorted by row in batches of ST_PIXELS_BATCH, and adjacent ones are sent together.
+ * If a point is given more than once in a batch, the last one is drawn.
+ * Arrays are not needed after the call returns.
+ * @param disp display
+ * @param points positions of the pixels
+ * @param colors 16-bit RGB565 color of each pixel
+ * @param n number of pixels
+ */
+void st_draw_pixels(st_display_t *disp, const st_point_t *points, const uint16_t *colors, uint16_t n)
+{
+	_st_draw_pixels(disp, points, colors, 0, n);
+}
+
+
+/**
+ * Draw many pixels of the same `color`. Same as st_draw_pixels().
+ * @param disp display
+ * @param points positions of the pixels
+ * @param n number of pixels
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_pixels_color(st_display_t *disp, const st_point_t *points, uint16_t n, uint16_t color)
+{
+	_st_draw_pixels(disp, points, NULL, color, n);
+}
+
+
+/*
+ * sin() of 0 - 90 degrees, scaled by 2^14
+ */
+static const int16_t _st_sin_table[91] =
+{
+	0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+	2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+	5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+	8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+	10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+	12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+	14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+	15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+	16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+	16384,
+};
+
+/*
+ * sin() of `angle` degrees, scaled by 2^14
+ */
+static int16_t _st_sin(int16_t angle)
+{
+	angle %= 360;
+	if (angle < 0)
+		angle += 360;
+
+	if (angle <= 90)
+		return _st_sin_table[angle];
+	else if (angle <= 180)
+		return _st_sin_table[180 - angle];
+	else if (angle <= 270)
+		return -_st_sin_table[angle - 180];
+	else
+		return -_st_sin_table[360 - angle];
+}
+
+/*
+ * cos() of `angle` degrees, scaled by 2^14
+ */
+static int16_t _st_cos(int16_t angle)
+{
+	return _st_sin(angle + 90);
+}
+
+
+/*
+ * Arc of a circle, clockwise from a start angle to an end angle
+ */
+typedef struct
+{
+	int32_t sx, sy;				// direction of the start angle
+	int32_t ex, ey;				// direction of the end angle
+	uint8_t wide;				// 1 if the arc is longer than 180 degrees
+} st_arc_t;
+
+/*
+ * Angles are in degrees, 0 is at 3 o'clock and 90 at 6 o'clock. They must not be equal.
+ */
+static void _st_arc_init(st_arc_t *arc, uint16_t start_angle, uint16_t end_angle)
+{
+	start_angle %= 360;
+	end_angle %= 360;
+	arc->sx = _st_cos(start_angle);
+	arc->sy = _st_sin(start_angle);
+	arc->ex = _st_cos(end_angle);
+	arc->ey = _st_sin(end_angle);
+	arc->wide = (end_angle + 360 - start_angle) % 360 > 180;
+}
+
+/*
+ * Check if a point at (dx,dy) from the center is on the arc
+ */
+static uint8_t _st_in_arc(const st_arc_t *arc, int32_t dx, int32_t dy)
+{
+	uint8_t after_start = arc->sx * dy - arc->sy * dx >= 0;
+	uint8_t before_end = dx * arc->ey - dy * arc->ex >= 0;
+
+	return arc->wide ? (after_start || before_end) : (after_start && before_end);
+}
+
+
+/*
+ * Integer square root (floor)
+ */
+static uint32_t _st_isqrt(uint64_t n)
+{
+	uint64_t root = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > n)
+		bit >>= 2;
+	while (bit)
+	{
+		if (n >= root + bit)
+		{
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)root;
+}
+
+
+/*
+ * Blend `fg` over `bg` with `alpha` (0 - 255) in RGB565
+ */
+static uint16_t _st_blend(uint16_t fg, uint16_t bg, uint8_t alpha)
+{
+	// Spread the channels apart (-----GGGGGG-----RRRRR------BBBBB), so one multiply scales all three
+	uint32_t f = (fg | ((uint32_t)fg << 16)) & 0x07E0F81F;
+	uint32_t b = (bg | ((uint32_t)bg << 16)) & 0x07E0F81F;
+	uint32_t a = ((uint32_t)alpha + 4) >> 3;	// 0 - 32
+	uint32_t c = (b + (((f - b) * a) >> 5)) & 0x07E0F81F;
+	return (uint16_t)(c | (c >> 16));
+}
+
+
+/*
+ * Anti-aliased drawing.
+ * A curve is walked along its major axis `u`. At every `u` it covers pixel `v` with 255 - alpha
+ * and pixel `v + 1` with alpha. Points with the same `v` are collected into a run, and a run is
+ * sent as one window of 2 x n blended pixels. So an anti-aliased line costs about the same as a
+ * 2px thick line. Runs are mapped to the screen by mirroring and swapping axes, so the 8 octants
+ * of a circle share one walk.
+ */
+typedef struct
+{
+	int16_t cx, cy;				// screen position of u = 0, v = 0
+	int8_t mu, mv;				// 1 or -1 to mirror u or v
+	uint8_t swap;				// 1 if u is along the screen's y axis
+} st_aa_map_t;
+
+typedef struct
+{
+	st_display_t *disp;
+	const st_aa_map_t *maps;
+	uint8_t n_maps;
+	const st_arc_t *arc;		// NULL if not clipped to an arc
+	uint16_t color, bg_color;
+	int16_t u1, v;				// start of the run being collected
+	uint16_t n;
+	uint8_t alpha[ST_PIXBUF_LEN / 4];
+} st_aa_runs_t;
+
+
+/*
+ * Send columns u1 - u2 of the collected run through `map` as one window
+ */
+static void _st_aa_block(st_aa_runs_t *runs, const st_aa_map_t *map, int16_t u1, int16_t u2, const uint8_t *alpha)
+{
+	st_display_t *disp = runs->disp;
+	int16_t v = runs->v;
+
+	// Corners of the run on the screen
+	int16_t xa = map->cx + (map->swap ? map->mv * v : map->mu * u1);
+	int16_t ya = map->cy + (map->swap ? map->mu * u1 : map->mv * v);
+	int16_t xb = map->cx + (map->swap ? map->mv * (v + 1) : map->mu * u2);
+	int16_t yb = map->cy + (map->swap ? map->mu * u2 : map->mv * (v + 1));
+
+	int16_t x1 = xa < xb ? xa : xb;
+	int16_t x2 = xa < xb ? xb : xa;
+	int16_t y1 = ya < yb ? ya : yb;
+	int16_t y2 = ya < yb ? yb : ya;
+
+	if (!_st_clip(disp, &x1, &y1, &x2, &y2))
+		return;
+
+	st_set_address_window(disp, x1, y1, x2, y2);
+
+	uint16_t n = (x2 - x1 + 1) * (y2 - y1 + 1);
+	uint16_t *buf = _st_pixbuf_get(disp, n);
+	uint16_t *p = buf;
+
+	// Back to drawing coordinates
+	x1 -= disp->origin_x;
+	x2 -= disp->origin_x;
+	y1 -= disp->origin_y;
+	y2 -= disp->origin_y;
+
+	for (int16_t y = y1; y <= y2; y++)
+	{
+		for (int16_t x = x1; x <= x2; x++)
+		{
+			int16_t u = map->mu * (map->swap ? y - map->cy : x - map->cx);
+			int16_t pv = map->mv * (map->swap ? x - map->cx : y - map->cy);
+			uint8_t a = alpha[u - u1];
+			*p++ = _st_blend(runs->color, runs->bg_color, pv == v ? 255 - a : a);
+		}
+	}
+
+	st_queue_data16(disp, buf, n);
+}
+
+
+/*
+ * Send the collected run through every map
+ */
+static void _st_aa_flush(st_aa_runs_t *runs)
+{
+	for (uint8_t m = 0; m < runs->n_maps; m++)
+	{
+		const st_aa_map_t *map = &runs->maps[m];
+		uint16_t i = 0;
+
+		while (i < runs->n)
+		{
+			// Split the run where it leaves the arc. Mirrored maps skip u = 0, which is on the axis.
+			uint16_t j = i;
+			while (j < runs->n)
+			{
+				int16_t u = runs->u1 + j;
+				uint8_t on = !(map->mu < 0 && u == 0);
+				if (on && runs->arc)
+				{
+					int32_t dx = map->swap ? map->mv * runs->v : map->mu * u;
+					int32_t dy = map->swap ? map->mu * u : map->mv * runs->v;
+					on = _st_in_arc(runs->arc, dx, dy);
+				}
+				if (!on)
+					break;
+				j++;
+			}
+
+			if (j > i)
+				_st_aa_block(runs, map, runs->u1 + i, runs->u1 + j - 1, &runs->alpha[i]);
+			else
+				j++;
+			i = j;
+		}
+	}
+	runs->n = 0;
+}
+
+
+/*
+ * Add point `u` of the walk, covering pixel `v` with 255 - `alpha` and pixel `v + 1` with `alpha`.
+ * `u` must increase by 1 on every call.
+ */
+static void _st_aa_add(st_aa_runs_t *runs, int16_t u, int16_t v, uint8_t alpha)
+{
+	if (runs->n && (v != runs->v || runs->n == sizeof(runs->alpha)))
+		_st_aa_flush(runs);
+	if (runs->n == 0)
+	{
+		runs->u1 = u;
+		runs->v = v;
+	}
+	runs->alpha[runs->n++] = alpha;
+}
+
+
+/**
+ * Draw an anti-aliased 1px line from (x0,y0) to (x1,y1) (Xiaolin Wu's algorithm).
+ * Edge pixels are blended with `bg_color`, so the background under the line must be of that color.
+ * @param disp display
+ * @param x0 start column address
+ * @param y0 start row address
+ * @param x1 end column address
+ * @param y1 end row address
+ * @param color 16-bit RGB565 color of the line
+ * @param bg_color 16-bit RGB565 color of the background
+ */
+void st_draw_line_aa(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color, uint16_t bg_color)
+{
+	// Nothing to smooth
+	if (x0 == x1 || y0 == y1)
+	{
+		st_draw_line(disp, x0, y0, x1, y1, 1, color);
+		return;
+	}
+
+	uint8_t steep = abs(y1 - y0) > abs(x1 - x0);
+	int16_t u0 = steep ? y0 : x0;
+	int16_t v0 = steep ? x0 : y0;
+	int16_t u1 = steep ? y1 : x1;
+	int16_t v1 = steep ? x1 : y1;
+	if (u0 > u1)
+	{
+		int16_t t;
+		t = u0; u0 = u1; u1 = t;
+		t = v0; v0 = v1; v1 = t;
+	}
+
+	st_aa_map_t map = {0, 0, 1, 1, steep};
+	st_aa_runs_t runs = {disp, &map, 1, NULL, color, bg_color, 0, 0, 0, {0}};
+
+	// v in 16.16 fixed point
+	int32_t gradient = (int32_t)(v1 - v0) * 65536 / (u1 - u0);
+	int32_t v = (int32_t)v0 * 65536;
+
+	for (int16_t u = u0; u <= u1; u++)
+	{
+		_st_aa_add(&runs, u, (int16_t)(v >> 16), (uint8_t)(v >> 8));
+		v += gradient;
+	}
+	_st_aa_flush(&runs);
+}
+
+
+/*
+ * Walk an octant of the circle, from the top (u = x = 0, v = y = r) to the diagonal
+ */
+static void _st_aa_circle(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, const st_arc_t *arc, uint16_t color, uint16_t bg_color)
+{
+	st_aa_map_t maps[8];
+	for (uint8_t m = 0; m < 8; m++)
+	{
+		maps[m].cx = x;
+		maps[m].cy = y;
+		maps[m].mu = (m & 1) ? -1 : 1;
+		maps[m].mv = (m & 2) ? -1 : 1;
+		maps[m].swap = (m & 4) ? 1 : 0;
+	}
+	st_aa_runs_t runs = {disp, maps, 8, arc, color, bg_color, 0, 0, 0, {0}};
+
+	for (uint16_t u = 0; u <= r; u++)
+	{
+		// v in 8.8 fixed point
+		uint32_t v = _st_isqrt(((uint64_t)r * r - (uint32_t)u * u) << 16);
+		if (u > (v >> 8))
+			break;
+		_st_aa_add(&runs, u, (int16_t)(v >> 8), (uint8_t)v);
+	}
+	_st_aa_flush(&runs);
+}
+
+
+/**
+ * Draw an anti-aliased 1px circle. Edge pixels are blended with `bg_color`.
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param color 16-bit RGB565 color of the circle
+ * @param bg_color 16-bit RGB565 color of the background
+ */
+void st_draw_circle_aa(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t color, uint16_t bg_color)
+{
+	_st_aa_circle(disp, x, y, r, NULL, color, bg_color);
+}
+
+
+/**
+ * Draw an anti-aliased 1px arc of a circle, clockwise from `start_angle` to `end_angle`.
+ * Angles are in degrees, 0 is at 3 o'clock and 90 at 6 o'clock. Equal angles draw the whole circle.
+ * Edge pixels are blended with `bg_color`.
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param start_angle start of the arc (0 - 359)
+ * @param end_angle end of the arc (0 - 359)
+ * @param color 16-bit RGB565 color of the arc
+ * @param bg_color 16-bit RGB565 color of the background
+ */
+void st_draw_arc_aa(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t start_angle, uint16_t end_angle, uint16_t color, uint16_t bg_color)
+{
+	start_angle %= 360;
+	end_angle %= 360;
+	if (start_angle == end_angle)
+	{
+		_st_aa_circle(disp, x, y, r, NULL, color, bg_color);
+		return;
+	}
+
+	st_arc_t arc;
+	_st_arc_init(&arc, start_angle, end_angle);
+	_st_aa_circle(disp, x, y, r, &arc, color, bg_color);
+}
+
+
+/*
+ * Walk the rows of an ellipse, from the top (dy = ry) to the center (dy = 0), giving the half-width of
+ * each row. A pixel is inside if its center is inside the ellipse with radii rx + 1/2 and ry + 1/2,
+ * the same test the midpoint algorithm does. For a circle it's x^2 + y^2 <= r^2 + r.
+ * The half-width only grows towards the center, so it's found by stepping x. The test is kept as
+ * the difference f = a * (x + 1)^2 + b * y^2 - c, which stays small while c itself would overflow
+ * int64_t for radii above ~27000. Half-widths are given up to `max_x`, as columns further out are
+ * never drawn.
+ */
+typedef struct
+{
+	int64_t a, b;			// inside if a * x^2 + b * y^2 <= c
+	int64_t f;				// x + 1 is inside if f <= 0
+	int32_t x, y, max_x;
+} st_ellipse_walk_t;
+
+static void _st_ellipse_walk_init(st_ellipse_walk_t *walk, uint16_t rx, uint16_t ry, int32_t max_x)
+{
+	int64_t dx = 2 * (int64_t)rx + 1;
+	int64_t dy = 2 * (int64_t)ry + 1;
+	walk->a = 4 * dy * dy;
+	walk->b = 4 * dx * dx;
+	walk->f = walk->a - dx * dx * (4 * (int64_t)ry + 1);
+	walk->x = 0;
+	walk->y = ry;
+	walk->max_x = rx < max_x ? rx : max_x;
+}
+
+/*
+ * Half-width of the current row. Moves to the next row.
+ */
+static int32_t _st_ellipse_walk_next(st_ellipse_walk_t *walk)
+{
+	while (walk->x < walk->max_x && walk->f <= 0)
+	{
+		walk->x++;
+		walk->f += walk->a * (2 * walk->x + 1);
+	}
+	// f isn't needed once x is at its limit, and wouldn't stay small
+	if (walk->x < walk->max_x)
+		walk->f += walk->b * (1 - 2 * (int64_t)walk->y);
+	walk->y--;
+	return walk->x;
+}
+
+/*
+ * Distance from `c` to the furthest of columns (or rows) `lo` - `hi`, plus one. A span reaching
+ * that far from `c` covers the same pixels as any longer one.
+ */
+static int32_t _st_clip_reach(int32_t c, int32_t lo, int32_t hi)
+{
+	int32_t d = (c - lo > hi - c) ? c - lo : hi - c;
+	return d < 0 ? 0 : d + 1;
+}
+
+
+/*
+ * Rows of a shape symmetric around (cx,cy). Row `dy` covers the pixels with a <= |x - cx| <= b
+ * (one span if a is 0, else two), both above and below the center. Rows are given from the top
+ * to the center, and adjacent rows with the same spans are sent as one rectangle.
+ */
+typedef struct
+{
+	st_display_t *disp;
+	int16_t cx, cy;
+	uint16_t color;
+	uint8_t open;				// 1 if rows dy_lo - dy_hi are collected
+	int32_t dy_hi, dy_lo;		// radii may be up to 65535
+	int32_t a, b;
+} st_sym_rows_t;
+
+static void _st_sym_area(st_sym_rows_t *rows, int32_t y1, int32_t y2)
+{
+	if (rows->a == 0)
+	{
+		_st_fill_area_wide(rows->disp, rows->cx - rows->b, y1, rows->cx + rows->b, y2, rows->color);
+	}
+	else
+	{
+		_st_fill_area_wide(rows->disp, rows->cx - rows->b, y1, rows->cx - rows->a, y2, rows->color);
+		_st_fill_area_wide(rows->disp, rows->cx + rows->a, y1, rows->cx + rows->b, y2, rows->color);
+	}
+}
+
+static void _st_sym_flush(st_sym_rows_t *rows)
+{
+	if (!rows->open)
+		return;
+
+	if (rows->dy_lo == 0)
+	{
+		_st_sym_area(rows, rows->cy - rows->dy_hi, rows->cy + rows->dy_hi);
+	}
+	else
+	{
+		_st_sym_area(rows, rows->cy - rows->dy_hi, rows->cy - rows->dy_lo);
+		_st_sym_area(rows, rows->cy + rows->dy_lo, rows->cy + rows->dy_hi);
+	}
+	rows->open = 0;
+}
+
+static void _st_sym_row(st_sym_rows_t *rows, int32_t dy, int32_t a, int32_t b)
+{
+	if (rows->open && a == rows->a && b == rows->b)
+	{
+		rows->dy_lo = dy;
+		return;
+	}
+
+	_st_sym_flush(rows);
+	rows->open = 1;
+	rows->dy_hi = rows->dy_lo = dy;
+	rows->a = a;
+	rows->b = b;
+}
+
+
+/*
+ * Draw an ellipse as horizontal spans. Filled if `outline` is 0. If `inner_ry` is not negative,
+ * the ellipse with radii `inner_rx`, `inner_ry` (up to 65535) is left out (ring).
+ * Rows and columns beyond the clip rectangle are walked over but never sent.
+ */
+static void _st_ellipse(st_display_t *disp, uint16_t x, uint16_t y, uint16_t rx, uint16_t ry, uint8_t outline, uint16_t inner_rx, int32_t inner_ry, uint16_t color)
+{
+	st_ellipse_walk_t walk, inner;
+	st_sym_rows_t rows = {disp, x, y, color, 0, 0, 0, 0, 0};
+	int32_t prev = -1;
+	int32_t reach_x = _st_clip_reach(rows.cx, disp->clip_x1 - disp->origin_x, disp->clip_x2 - disp->origin_x);
+	int32_t reach_y = _st_clip_reach(rows.cy, disp->clip_y1 - disp->origin_y, disp->clip_y2 - disp->origin_y);
+
+	_st_ellipse_walk_init(&walk, rx, ry, reach_x);
+	_st_ellipse_walk_init(&inner, inner_rx, inner_ry >= 0 ? inner_ry : 0, reach_x);
+
+	for (int32_t dy = ry; dy >= 0; dy--)
+	{
+		int32_t b = _st_ellipse_walk_next(&walk);
+		int32_t a = 0;
+
+		if (outline)
+		{
+			// Pixels not covered by the row above (further from the center), at least one
+			a = prev + 1 < b ? prev + 1 : b;
+		}
+		else if (inner_ry >= 0 && dy <= inner_ry)
+		{
+			a = _st_ellipse_walk_next(&inner) + 1;
+			if (a > b)
+				a = b + 1;
+		}
+		prev = b;
+
+		if (dy >= reach_y)
+			continue;
+		if (a <= b)
+			_st_sym_row(&rows, dy, a, b);
+		else
+			_st_sym_flush(&rows);
+	}
+	_st_sym_flush(&rows);
+}
 
 
 /**
- * Set an area for drawing on the display with start row,col and end row,col.
- * User don't need to call it usually, call it only before some functions who don't call it by default.
- * @param x1 start column address.
- * @param y1 start row address.
- * @param x2 end column address.
- * @param y2 end row address.
+ * Draw a 1px circle
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_circle(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t color)
+{
+	_st_ellipse(disp, x, y, r, r, 1, 0, -1, color);
+}
+
+
+/**
+ * Draw a filled circle
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_circle(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t color)
+{
+	_st_ellipse(disp, x, y, r, r, 0, 0, -1, color);
+}
+
+
+/**
+ * Draw a 1px ellipse
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param rx horizontal radius
+ * @param ry vertical radius
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_ellipse(st_display_t *disp, uint16_t x, uint16_t y, uint16_t rx, uint16_t ry, uint16_t color)
+{
+	_st_ellipse(disp, x, y, rx, ry, 1, 0, -1, color);
+}
+
+
+/**
+ * Draw a filled ellipse
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param rx horizontal radius
+ * @param ry vertical radius
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_ellipse(st_display_t *disp, uint16_t x, uint16_t y, uint16_t rx, uint16_t ry, uint16_t color)
+{
+	_st_ellipse(disp, x, y, rx, ry, 0, 0, -1, color);
+}
+
+
+/**
+ * Draw a filled ring: the pixels of the circle with radius `r_outer` which are not in the
+ * circle with radius `r_inner`
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r_outer outer radius
+ * @param r_inner inner radius, less than `r_outer`
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_ring(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r_outer, uint16_t r_inner, uint16_t color)
+{
+	if (r_inner >= r_outer)
+		return;
+	_st_ellipse(disp, x, y, r_outer, r_outer, 0, r_inner, r_inner, color);
+}
+
+
+/*
+ * Rows of up to 4 spans. Adjacent rows with the same spans are sent as one rectangle per span.
+ * Rows may be given from the top or from the bottom.
+ */
+typedef struct
+{
+	st_display_t *disp;
+	uint16_t color;
+	uint8_t n;					// spans of the collected rows
+	int16_t x1[4], x2[4];
+	int16_t y1, y2;				// first and last collected row
+} st_span_rows_t;
+
+static void _st_span_rows_flush(st_span_rows_t *rows)
+{
+	int16_t y1 = rows->y1 < rows->y2 ? rows->y1 : rows->y2;
+	int16_t y2 = rows->y1 < rows->y2 ? rows->y2 : rows->y1;
+	for (uint8_t i = 0; i < rows->n; i++)
+		_st_fill_area(rows->disp, rows->x1[i], y1, rows->x2[i], y2, rows->color);
+	rows->n = 0;
+}
+
+static void _st_span_rows_add(st_span_rows_t *rows, int16_t y, uint8_t n, const int16_t *x1, const int16_t *x2)
+{
+	uint8_t same = (n == rows->n);
+	for (uint8_t i = 0; i < n && same; i++)
+		same = (x1[i] == rows->x1[i] && x2[i] == rows->x2[i]);
+	if (same && n)
+	{
+		rows->y2 = y;
+		return;
+	}
+
+	_st_span_rows_flush(rows);
+	rows->n = n;
+	for (uint8_t i = 0; i < n; i++)
+	{
+		rows->x1[i] = x1[i];
+		rows->x2[i] = x2[i];
+	}
+	rows->y1 = rows->y2 = y;
+}
+
+
+/*
+ * floor(n / d), d is not 0
+ */
+static int32_t _st_floor_div(int32_t n, int32_t d)
+{
+	if (d < 0)
+	{
+		n = -n;
+		d = -d;
+	}
+	return (n >= 0) ? n / d : -((-n + d - 1) / d);
+}
+
+/*
+ * Columns (dx) of row `dy` which are on the arc (see _st_in_arc()), as up to 2 intervals.
+ * Each edge of the arc is a half plane, so on a row it's a half line found by one division.
+ * Returns the number of intervals.
+ */
+static uint8_t _st_arc_row(const st_arc_t *arc, int32_t dy, int32_t *lo, int32_t *hi)
+{
+	// Unbounded ends. Rows of a circle are much shorter.
+	int32_t l1 = -(1 << 30), h1 = 1 << 30;
+	int32_t l2 = -(1 << 30), h2 = 1 << 30;
+
+	// After the start: sy * dx <= sx * dy
+	int32_t n1 = arc->sx * dy;
+	if (arc->sy > 0)
+		h1 = _st_floor_div(n1, arc->sy);
+	else if (arc->sy < 0)
+		l1 = -_st_floor_div(-n1, arc->sy);
+	else if (n1 < 0)
+		l1 = h1 + 1;
+
+	// Before the end: ey * dx >= ex * dy
+	int32_t n2 = arc->ex * dy;
+	if (arc->ey > 0)
+		l2 = -_st_floor_div(-n2, arc->ey);
+	else if (arc->ey < 0)
+		h2 = _st_floor_div(n2, arc->ey);
+	else if (n2 > 0)
+		l2 = h2 + 1;
+
+	if (!arc->wide)
+	{
+		lo[0] = l1 > l2 ? l1 : l2;
+		hi[0] = h1 < h2 ? h1 : h2;
+		return lo[0] <= hi[0];
+	}
+
+	uint8_t n = 0;
+	if (l1 <= h1)
+	{
+		lo[n] = l1;
+		hi[n++] = h1;
+	}
+	if (l2 <= h2)
+	{
+		lo[n] = l2;
+		hi[n++] = h2;
+	}
+	// Overlapping or touching: one interval
+	if (n == 2 && (l1 > l2 ? l1 : l2) <= (h1 < h2 ? h1 : h2) + 1)
+	{
+		lo[0] = l1 < l2 ? l1 : l2;
+		hi[0] = h1 > h2 ? h1 : h2;
+		n = 1;
+	}
+	return n;
+}
+
+
+/*
+ * Draw the part of a circle that is on `arc`, as horizontal spans. The circle is filled, 1px
+ * (`outline`) or a ring (`r_inner` not negative), with the same pixels as _st_ellipse().
+ * The arc cuts every row of the circle into at most 4 spans. The upper and lower halves
+ * are walked separately, from the top and from the bottom row to the center.
+ */
+static void _st_circle_arc(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint8_t outline, int32_t r_inner, const st_arc_t *arc, uint16_t color)
+{
+	int16_t cx = x, cy = y;
+	int32_t left = disp->clip_x1 - disp->origin_x, right = disp->clip_x2 - disp->origin_x;
+	int32_t top = disp->clip_y1 - disp->origin_y, bottom = disp->clip_y2 - disp->origin_y;
+	int32_t reach_x = _st_clip_reach(cx, left, right);
+
+	for (int8_t sign = -1; sign <= 1; sign += 2)
+	{
+		st_ellipse_walk_t walk, inner;
+		st_span_rows_t rows = {disp, color, 0, {0}, {0}, 0, 0};
+		int32_t prev = -1;
+
+		_st_ellipse_walk_init(&walk, r, r, reach_x);
+		_st_ellipse_walk_init(&inner, r_inner >= 0 ? r_inner : 0, r_inner >= 0 ? r_inner : 0, reach_x);
+
+		for (int32_t d = r; d >= (sign < 0 ? 0 : 1); d--)
+		{
+			// Row of the circle: |dx| from a to b
+			int32_t b = _st_ellipse_walk_next(&walk);
+			int32_t a = 0;
+			if (outline)
+			{
+				a = prev + 1 < b ? prev + 1 : b;
+			}
+			else if (r_inner >= 0 && d <= r_inner)
+			{
+				a = _st_ellipse_walk_next(&inner) + 1;
+				if (a > b)
+					a = b + 1;
+			}
+			prev = b;
+
+			// Rows and columns beyond the clip rectangle are never sent
+			int32_t row = cy + sign * d;
+			if (row < top || row > bottom)
+				continue;
+
+			int32_t span_lo[2] = {-b, a};
+			int32_t span_hi[2] = {-a, b};
+			uint8_t n_spans = (a > b) ? 0 : (a == 0) ? 1 : 2;
+			if (a == 0)
+				span_hi[0] = b;
+
+			int32_t arc_lo[2], arc_hi[2];
+			uint8_t n_arc = _st_arc_row(arc, sign * d, arc_lo, arc_hi);
+
+			int16_t x1[4], x2[4];
+			uint8_t n = 0;
+			for (uint8_t i = 0; i < n_arc; i++)
+			{
+				for (uint8_t j = 0; j < n_spans; j++)
+				{
+					int32_t lo = arc_lo[i] > span_lo[j] ? arc_lo[i] : span_lo[j];
+					int32_t hi = arc_hi[i] < span_hi[j] ? arc_hi[i] : span_hi[j];
+					if (lo < left - cx)
+						lo = left - cx;
+					if (hi > right - cx)
+						hi = right - cx;
+					if (lo <= hi)
+					{
+						x1[n] = cx + lo;
+						x2[n] = cx + hi;
+						n++;
+					}
+				}
+			}
+			_st_span_rows_add(&rows, row, n, x1, x2);
+		}
+		_st_span_rows_flush(&rows);
+	}
+}
+
+
+/**
+ * Draw a 1px arc of a circle, clockwise from `start_angle` to `end_angle`.
+ * Angles are in degrees, 0 is at 3 o'clock and 90 at 6 o'clock. Equal angles draw the whole circle.
+ * Pixels are the same as those of `st_draw_circle()`.
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param start_angle start of the arc (0 - 359)
+ * @param end_angle end of the arc (0 - 359)
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_arc(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t start_angle, uint16_t end_angle, uint16_t color)
+{
+	if (start_angle % 360 == end_angle % 360)
+	{
+		st_draw_circle(disp, x, y, r, color);
+		return;
+	}
+
+	st_arc_t arc;
+	_st_arc_init(&arc, start_angle, end_angle);
+	_st_circle_arc(disp, x, y, r, 1, -1, &arc, color);
+}
+
+
+/**
+ * Draw a segment of a filled ring (a gauge), clockwise from `start_angle` to `end_angle`.
+ * Angles are in degrees, 0 is at 3 o'clock and 90 at 6 o'clock. Equal angles draw the whole ring.
+ * Pixels are the same as those of `st_fill_ring()`. Each row is a few spans, so a gauge
+ * is a few hundred fills.
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r_outer outer radius
+ * @param r_inner inner radius, less than `r_outer`
+ * @param start_angle start of the segment (0 - 359)
+ * @param end_angle end of the segment (0 - 359)
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_ring_segment(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r_outer, uint16_t r_inner, uint16_t start_angle, uint16_t end_angle, uint16_t color)
+{
+	if (r_inner >= r_outer)
+		return;
+	if (start_angle % 360 == end_angle % 360)
+	{
+		st_fill_ring(disp, x, y, r_outer, r_inner, color);
+		return;
+	}
+
+	st_arc_t arc;
+	_st_arc_init(&arc, start_angle, end_angle);
+	_st_circle_arc(disp, x, y, r_outer, 0, r_inner, &arc, color);
+}
+
+
+/**
+ * Draw a filled rectangle with rounded corners. The straight middle part is one fill,
+ * corners are quarter circles of radius `r` sent as spans.
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ * @param w Width of rectangle
+ * @param h Height of rectangle
+ * @param r radius of the corners, at most half of the width and the height
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_round_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t r, uint16_t color)
+{
+	if (w == 0 || h == 0)
+		return;
+	if (r > w / 2)
+		r = w / 2;
+	if (r > h / 2)
+		r = h / 2;
+
+	int16_t x1 = x, y1 = y;
+	int16_t x2 = x + w - 1, y2 = y + h - 1;
+	_st_fill_area(disp, x1, y1 + r, x2, y2 - r, color);
+
+	// Rows of the corners, from the top and bottom edges inwards
+	st_ellipse_walk_t walk;
+	st_span_rows_t top = {disp, color, 0, {0}, {0}, 0, 0};
+	st_span_rows_t bottom = {disp, color, 0, {0}, {0}, 0, 0};
+	_st_ellipse_walk_init(&walk, r, r, r);
+
+	for (int16_t d = r; d >= 1; d--)
+	{
+		int16_t b = _st_ellipse_walk_next(&walk);
+		int16_t sx1 = x1 + r - b;
+		int16_t sx2 = x2 - r + b;
+		_st_span_rows_add(&top, y1 + r - d, sx1 <= sx2, &sx1, &sx2);
+		_st_span_rows_add(&bottom, y2 - r + d, sx1 <= sx2, &sx1, &sx2);
+	}
+	_st_span_rows_flush(&top);
+	_st_span_rows_flush(&bottom);
+}
+
+
+/*
+ * Active edge of a polygon. Its x at the current row is x + r / den exactly. It is stepped
+ * like Bresenham's lines, by adding the integer quotient and remainder of the slope.
+ * Vertices may be anywhere in int16_t range, so edges can be up to 65535 high and wide.
+ */
+typedef struct
+{
+	int32_t x;				// integer part of x at the current row
+	int32_t r;				// fraction of x, in 1 / den units
+	int32_t step;			// integer part of the slope (floor)
+	int32_t rem;			// fraction of the slope, in 1 / den units
+	int32_t den;			// height of the edge
+	int16_t y_end;			// first row below the edge
+} st_poly_edge_t;
+
+
+/*
+ * Check if edge `a` is left of edge `b` on the current row
+ */
+static uint8_t _st_poly_edge_before(const st_poly_edge_t *a, const st_poly_edge_t *b)
+{
+	if (a->x != b->x)
+		return a->x < b->x;
+	return (int64_t)a->r * b->den < (int64_t)b->r * a->den;
+}
+
+
+/*
+ * Fill columns x1 - x2 of row y of a polygon. Edges may cross the row far outside int16_t range,
+ * so the span is cut to the clip rectangle first.
+ */
+static void _st_poly_span(st_display_t *disp, int32_t x1, int32_t x2, int16_t y, uint16_t color)
+{
+	int32_t left = disp->clip_x1 - disp->origin_x;
+	int32_t right = disp->clip_x2 - disp->origin_x;
+	if (x1 < left)
+		x1 = left;
+	if (x2 > right)
+		x2 = right;
+	if (x1 <= x2)
+		_st_fill_area(disp, x1, y, x2, y, color);
+}
+
+
+/*
+ * Fill row `y` of a polygon without the active edge table. Used when the table is full.
+ * Crossings are taken in order by searching all edges for the next one, so it's slow but needs no memory.
+ */
+static void _st_poly_fill_row(st_display_t *disp, const st_point_t *points, uint16_t n, int16_t y, uint16_t color)
+{
+	int32_t prev = INT32_MIN;
+	int32_t start = 0;
+	uint8_t inside = 0;
+
+	while (1)
+	{
+		// First pixel right of the next crossing(s)
+		int32_t next = INT32_MAX;
+		uint16_t count = 0;
+
+		for (uint16_t i = 0; i < n; i++)
+		{
+			const st_point_t *p0 = &points[i];
+			const st_point_t *p1 = &points[(i + 1 == n) ? 0 : i + 1];
+			const st_point_t *top = p0->y < p1->y ? p0 : p1;
+			const st_point_t *bottom = p0->y < p1->y ? p1 : p0;
+			if (top->y > y || bottom->y <= y)
+				continue;
+
+			int32_t den = bottom->y - top->y;
+			int64_t num = (int64_t)top->x * den + (int64_t)(bottom->x - top->x) * (y - top->y);
+			int32_t x = (num >= 0 ? num + den - 1 : num) / den;		// ceil(num / den)
+
+			if (x > prev)
+			{
+				if (x < next)
+				{
+					next = x;
+					count = 1;
+				}
+				else if (x == next)
+				{
+					count++;
+				}
+			}
+		}
+
+		if (count == 0)
+			break;
+		if (count & 1)
+		{
+			inside ^= 1;
+			if (inside)
+				start = next;
+			else
+				_st_poly_span(disp, start, next - 1, y, color);
+		}
+		prev = next;
+	}
+}
+
+
+/**
+ * Draw a filled polygon. Self-intersecting polygons are filled with the even-odd rule.
+ * A pixel is filled if its center is inside, and pixels on the right or bottom edge are left out,
+ * so polygons sharing an edge don't overlap. Once a row crosses more than ST_POLY_MAX_EDGES edges,
+ * the remaining rows are filled by a slower method.
+ * @param disp display
+ * @param points vertices, may be outside the display
+ * @param n number of vertices
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_polygon(st_display_t *disp, const st_point_t *points, uint16_t n, uint16_t color)
+{
+	/*
+	* Scanline conversion: edges are added to the active edge table on their first row, their x is
+	* stepped on every row without any division, and the spans between pairs of edges are filled.
+	*/
+	if (n < 3)
+		return;
+
+	int16_t y_min = points[0].y;
+	int16_t y_max = points[0].y;
+	for (uint16_t i = 1; i < n; i++)
+	{
+		if (points[i].y < y_min)
+			y_min = points[i].y;
+		if (points[i].y > y_max)
+			y_max = points[i].y;
+	}
+
+	// Only rows inside the clip rectangle are walked (in drawing coordinates)
+	int16_t clip_y1 = disp->clip_y1 - disp->origin_y;
+	int16_t clip_y2 = disp->clip_y2 - disp->origin_y;
+	int16_t y_first = y_min > clip_y1 ? y_min : clip_y1;
+	int16_t y_last = y_max - 1 < clip_y2 ? y_max - 1 : clip_y2;
+
+	st_poly_edge_t active[ST_POLY_MAX_EDGES];
+	uint8_t n_active = 0;
+	int16_t next_start = y_first;		// next row where an edge starts
+
+	uint8_t overflow = 0;
+
+	for (int16_t y = y_first; y <= y_last; y++)
+	{
+		if (overflow)
+		{
+			_st_poly_fill_row(disp, points, n, y, color);
+			continue;
+		}
+
+		// Remove the edges which ended
+		uint8_t kept = 0;
+		for (uint8_t i = 0; i < n_active; i++)
+		{
+			if (active[i].y_end > y)
+				active[kept++] = active[i];
+		}
+		n_active = kept;
+
+		// Add the edges which start on this row (on the first row, also the ones that started above)
+		if (y == next_start)
+		{
+			next_start = INT16_MAX;
+			for (uint16_t i = 0; i < n; i++)
+			{
+				const st_point_t *p0 = &points[i];
+				const st_point_t *p1 = &points[(i + 1 == n) ? 0 : i + 1];
+				if (p0->y == p1->y)
+					continue;
+
+				const st_point_t *top = p0->y < p1->y ? p0 : p1;
+				const st_point_t *bottom = p0->y < p1->y ? p1 : p0;
+
+				if (top->y > y)
+				{
+					if (top->y < next_start)
+						next_start = top->y;
+					continue;
+				}
+				if (bottom->y <= y || (top->y < y && y != y_first))
+					continue;
+				if (n_active == ST_POLY_MAX_EDGES)
+				{
+					overflow = 1;
+					break;
+				}
+
+				// Floor division of the slope, and of the x offset at this row
+				st_poly_edge_t *edge = &active[n_active++];
+				int32_t dx = bottom->x - top->x;
+				int64_t offset = (int64_t)dx * (y - top->y);
+				edge->den = bottom->y - top->y;
+				edge->step = (dx >= 0 ? dx : dx - edge->den + 1) / edge->den;
+				edge->rem = dx - edge->step * edge->den;
+				int32_t whole = (offset >= 0 ? offset : offset - edge->den + 1) / edge->den;
+				edge->x = top->x + whole;
+				edge->r = offset - (int64_t)whole * edge->den;
+				edge->y_end = bottom->y;
+			}
+		}
+
+		if (overflow)
+		{
+			_st_poly_fill_row(disp, points, n, y, color);
+			continue;
+		}
+
+		// Sort by x. Edges keep their order from row to row mostly, so insertion sort is cheap.
+		for (uint8_t i = 1; i < n_active; i++)
+		{
+			st_poly_edge_t edge = active[i];
+			uint8_t j = i;
+			while (j > 0 && _st_poly_edge_before(&edge, &active[j - 1]))
+			{
+				active[j] = active[j - 1];
+				j--;
+			}
+			active[j] = edge;
+		}
+
+		// Fill the pixels with centers between each pair of edges
+		for (uint8_t i = 0; i + 1 < n_active; i += 2)
+		{
+			int32_t x1 = active[i].x + (active[i].r > 0);
+			int32_t x2 = active[i + 1].x + (active[i + 1].r > 0) - 1;
+			_st_poly_span(disp, x1, x2, y, color);
+		}
+
+		for (uint8_t i = 0; i < n_active; i++)
+		{
+			active[i].x += active[i].step;
+			active[i].r += active[i].rem;
+			if (active[i].r >= active[i].den)
+			{
+				active[i].x++;
+				active[i].r -= active[i].den;
+			}
+		}
+	}
+}
+
+
+/**
+ * Draw a filled triangle. Same fill rule as `st_fill_polygon()`.
+ * @param disp display
+ * @param x0 column address of the 1st vertex
+ * @param y0 row address of the 1st vertex
+ * @param x1 column address of the 2nd vertex
+ * @param y1 row address of the 2nd vertex
+ * @param x2 column address of the 3rd vertex
+ * @param y2 row address of the 3rd vertex
+ * @param color 16-bit RGB565 color
  */
-void st_set_address_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+void st_fill_triangle(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color)
 {
-	_st_write_command_8bit(ST7789_CASET);
+	st_point_t points[3] = {{x0, y0}, {x1, y1}, {x2, y2}};
+	st_fill_polygon(disp, points, 3, color);
+}
 
-	#ifdef ST_RELEASE_WHEN_IDLE
-		ST_CS_ACTIVE;
-	#endif
-	ST_DC_DAT;
-	ST_WRITE_8BIT((uint8_t)(x1 >> 8));
-	ST_WRITE_8BIT((uint8_t)x1);
-	ST_WRITE_8BIT((uint8_t)(x2 >> 8));
-	ST_WRITE_8BIT((uint8_t)x2);
 
+/*
+ * 1px segment of a polyline, with the same pixels as st_draw_line(). Its first and/or last point
+ * can be left out, when it's the joint with a segment drawn before.
+ */
+static void _st_thin_segment(st_display_t *disp, st_point_t p0, st_point_t p1, uint8_t skip_first, uint8_t skip_last, uint16_t color)
+{
+	// Same axis and direction as st_draw_line()
+	uint8_t steep = !(p0.y == p1.y || (p0.x != p1.x && abs(p1.y - p0.y) < abs(p1.x - p0.x)));
+	int16_t major0 = steep ? p0.y : p0.x, minor0 = steep ? p0.x : p0.y;
+	int16_t major1 = steep ? p1.y : p1.x, minor1 = steep ? p1.x : p1.y;
+	if (major0 > major1)
+	{
+		ST_SWAP(major0, major1);
+		ST_SWAP(minor0, minor1);
+		ST_SWAP(skip_first, skip_last);
+	}
 
-	_st_write_command_8bit(ST7789_RASET);
-	#ifdef ST_RELEASE_WHEN_IDLE
-		ST_CS_ACTIVE;
-	#endif
-	ST_DC_DAT;
-	ST_WRITE_8BIT((uint8_t)(y1 >> 8));
-	ST_WRITE_8BIT((uint8_t)y1);
-	ST_WRITE_8BIT((uint8_t)(y2 >> 8));
-	ST_WRITE_8BIT((uint8_t)y2);
+	int32_t d_minor = (int32_t)minor1 - minor0;
+	int8_t step = 1;
+	if (d_minor < 0)
+	{
+		step = -1;
+		d_minor = -d_minor;
+	}
 
-	_st_write_command_8bit(ST7789_RAMWR);
+	st_line_walk_t walk;
+	_st_line_walk_init(&walk, major0, major1, d_minor);
+	if (skip_last)
+		walk.end--;
+
+	// Only walk the part of the segment inside the clip rectangle (in drawing coordinates)
+	int32_t clip1 = steep ? disp->clip_y1 - disp->origin_y : disp->clip_x1 - disp->origin_x;
+	int32_t clip2 = steep ? disp->clip_y2 - disp->origin_y : disp->clip_x2 - disp->origin_x;
+	if (walk.end > clip2)
+		walk.end = clip2;
+	if (clip1 > walk.end)
+		return;
+
+	int16_t minor = minor0;
+	if (clip1 > walk.major)
+		minor += step * _st_line_walk_skip(&walk, clip1);
+	while (walk.major <= walk.end)
+	{
+		int16_t start, stop;
+		_st_line_walk_run(&walk, &start, &stop);
+		if (skip_first && start == major0)
+			start++;
+		if (start <= stop)
+			_st_line_span(disp, steep, start, stop, minor, minor, color);
+		minor += step;
+	}
 }
 
 
+/*
+ * Index of the vertex after points[i], skipping repeated points and the middle points of
+ * straight runs. `n` if there is none.
+ */
+static uint16_t _st_stroke_next(const st_point_t *points, uint16_t n, uint16_t i)
+{
+	uint16_t j = i + 1;
+	while (j < n && points[j].x == points[i].x && points[j].y == points[i].y)
+		j++;
+	if (j == n)
+		return n;
+
+	int32_t dx = points[j].x - points[i].x;
+	int32_t dy = points[j].y - points[i].y;
+	while (j + 1 < n)
+	{
+		int32_t ex = points[j + 1].x - points[j].x;
+		int32_t ey = points[j + 1].y - points[j].y;
+		// Same direction (or a repeated point)
+		if (dx * ey - dy * ex != 0 || dx * ex + dy * ey < 0)
+			break;
+		j++;
+	}
+	return j;
+}
+
 
 /*
- * Render a character glyph on the display. Called by `_st_draw_string_main()`
- * User need NOT call it
+ * Thick strokes. Every segment is a polygon `width` wide, centered on it. At a joint, both
+ * segments end on the same inner corner (where their inner edges meet), and the outer gap is
+ * filled by a miter, bevel or round join polygon. Neighbour polygons share their edges exactly,
+ * and the polygon fill rule leaves out right and bottom edges, so no pixel is drawn twice.
  */
-void _st_render_glyph(uint16_t x, uint16_t y, uint16_t fore_color, uint16_t back_color, const tImage *glyph, uint8_t is_bg)
+typedef struct
 {
-	uint16_t width = 0, height = 0;
+	int32_t dx, dy;				// direction (not normalized)
+	int32_t nx, ny;				// unit normal to the left (side A), scaled by 2^14
+	st_point_t a, b;			// offsets of the edges: side A (about +width/2 * n) and side B
+} st_stroke_seg_t;
 
-	width = glyph->width;
-	height = glyph->height;
+/*
+ * Cap of a segment at one end, from side A to side B. `mid` is set if the cap goes through
+ * the vertex itself.
+ */
+typedef struct
+{
+	st_point_t a, mid, b;
+	uint8_t has_mid;
+} st_stroke_cap_t;
 
-	uint16_t temp_x = x;
-	uint16_t temp_y = y;
+static void _st_stroke_seg_init(st_stroke_seg_t *seg, st_point_t p0, st_point_t p1, uint8_t width)
+{
+	seg->dx = p1.x - p0.x;
+	seg->dy = p1.y - p0.y;
+	uint32_t len = _st_isqrt((uint64_t)((int64_t)seg->dx * seg->dx + (int64_t)seg->dy * seg->dy) << 16);	// 8.8
+	seg->nx = (int32_t)((int64_t)seg->dy * (1 << 22) / len);
+	seg->ny = (int32_t)((int64_t)-seg->dx * (1 << 22) / len);
 
-	uint8_t mask = 0x80;
-	uint8_t bit_counter = 0;
+	// Rounded the same way on both sides, so an axis aligned stroke is exactly `width` pixels
+	int16_t wx = _st_floor_div(seg->nx * width + 8192, 16384);
+	int16_t wy = _st_floor_div(seg->ny * width + 8192, 16384);
+	seg->a.x = _st_floor_div(seg->nx * width + 16384, 32768);
+	seg->a.y = _st_floor_div(seg->ny * width + 16384, 32768);
+	seg->b.x = seg->a.x - wx;
+	seg->b.y = seg->a.y - wy;
+}
 
-	const uint8_t *glyph_data_ptr = (const uint8_t *)(glyph->data);
-	uint8_t glyph_data = 0;
+static st_point_t _st_stroke_add(st_point_t p, st_point_t offset)
+{
+	return (st_point_t){p.x + offset.x, p.y + offset.y};
+}
 
-	// font bitmaps are stored in column major order (scanned from left-to-right, not the conventional top-to-bottom)
-	// as font glyphs have heigher height than width, this scanning saves some storage.
-	// So, we also render in left-to-right manner.
+static st_stroke_cap_t _st_stroke_butt(st_point_t v, const st_stroke_seg_t *seg)
+{
+	st_stroke_cap_t cap = {_st_stroke_add(v, seg->a), v, _st_stroke_add(v, seg->b), 0};
+	return cap;
+}
 
-	// Along x axis (width)
-	for (int i = 0; i < width; i++)
+/*
+ * Where the edges of `s1` and `s2` with offsets `o1` and `o2` from vertex `v` meet. Returns 0 if
+ * they meet more than half a segment away from `v` (or never).
+ */
+static uint8_t _st_stroke_meet(st_point_t v, const st_stroke_seg_t *s1, st_point_t o1, const st_stroke_seg_t *s2, st_point_t o2, st_point_t *p)
+{
+	int64_t den = (int64_t)s1->dx * s2->dy - (int64_t)s1->dy * s2->dx;
+	int64_t ox = o2.x - o1.x, oy = o2.y - o1.y;
+	int64_t t = ox * s2->dy - oy * s2->dx;		// along s1 from v, in 1 / den units
+	int64_t s = ox * s1->dy - oy * s1->dx;		// along s2 from v
+	if (den == 0)
+		return 0;
+	if (den < 0)
 	{
-		// Along y axis (height)
-		for (int j = 0; j < height; j++)
-		{
+		den = -den;
+		t = -t;
+		s = -s;
+	}
+	if (2 * t < -den || 2 * s > den)
+		return 0;
 
-			// load new data only when previous byte (or word, depends on glyph->dataSize) is completely traversed by the mask
-			// bit_counter = 0 means glyph_data is completely traversed by the mask
-			if (bit_counter == 0)
-			{
-				glyph_data = *glyph_data_ptr++;
-				bit_counter = glyph->dataSize;
-			}
-			// Decrement bit counter
-			bit_counter--;
+	// Rounded to the nearest pixel: floor((t * d / den) + 1/2)
+	int64_t q[2] = {2 * t * s1->dx + den, 2 * t * s1->dy + den};
+	for (uint8_t i = 0; i < 2; i++)
+		q[i] = (q[i] >= 0) ? q[i] / (2 * den) : -((-q[i] + 2 * den - 1) / (2 * den));
+	p->x = v.x + o1.x + (int16_t)q[0];
+	p->y = v.y + o1.y + (int16_t)q[1];
+	return 1;
+}
 
-			//If pixel is blank
-			if (glyph_data & mask)
-			{
-				//Has background color (not transparent bg)
-				if (is_bg)
-				{
-					st_draw_pixel(temp_x, temp_y, back_color);
-				}
-			}
+/*
+ * Joint at `v` from `s1` to `s2`. Gives the end cap of s1 and the start cap of s2, and fills the join.
+ */
+static void _st_stroke_joint(st_display_t *disp, st_point_t v, const st_stroke_seg_t *s1, const st_stroke_seg_t *s2, uint8_t width, uint8_t join, uint16_t color, st_stroke_cap_t *end, st_stroke_cap_t *start)
+{
+	*end = _st_stroke_butt(v, s1);
+	*start = _st_stroke_butt(v, s2);
 
-			//if pixel is not blank
-			else
-			{
-				st_draw_pixel(temp_x, temp_y, fore_color);
-			}
+	// Straight on (or straight back)
+	int64_t turn = (int64_t)s1->dx * s2->dy - (int64_t)s1->dy * s2->dx;
+	if (turn == 0)
+		return;
 
-			glyph_data <<= 1;
-			temp_y++;
-		}
+	// Side A is outside when turning clockwise (on the screen)
+	uint8_t outer_a = turn > 0;
+	st_point_t o1 = outer_a ? s1->a : s1->b, o2 = outer_a ? s2->a : s2->b;
+	st_point_t i1 = outer_a ? s1->b : s1->a, i2 = outer_a ? s2->b : s2->a;
+
+	// Inner corner, shared by both segments
+	st_point_t inner;
+	uint8_t has_inner = _st_stroke_meet(v, s1, i1, s2, i2, &inner);
+
+	// Miter: the outer edges meet too, closer than 2 widths to the vertex
+	st_point_t miter;
+	uint8_t has_miter = (join == ST_JOIN_MITER) && _st_stroke_meet(v, s1, o1, s2, o2, &miter) &&
+						(int32_t)(miter.x - v.x) * (miter.x - v.x) + (int32_t)(miter.y - v.y) * (miter.y - v.y) <= 4 * (int32_t)width * width;
 
-		//New col starts. So, row is set to initial value and col is increased by one
-		temp_y = y;
-		temp_x++;
+	if (has_inner && has_miter)
+	{
+		// Segments meet on the line from the inner corner to the miter, no join polygon
+		end->a = start->a = outer_a ? miter : inner;
+		end->b = start->b = outer_a ? inner : miter;
+		return;
+	}
+
+	// Segments end on the line from the inner corner (or their own inner corner) to the vertex,
+	// and the rest is cut perpendicular to them
+	end->has_mid = start->has_mid = 1;
+	if (has_inner)
+	{
+		if (outer_a)
+			end->b = start->b = inner;
+		else
+			end->a = start->a = inner;
+	}
 
-		//Reset the bit counter cause we're moving to next column, so we start with a new byte
-		bit_counter = 0;
+	// Join polygon: vertex, outer corner of s1, (miter or arc), outer corner of s2
+	st_point_t poly[24];
+	uint8_t n = 0;
+	poly[n++] = v;
+	poly[n++] = _st_stroke_add(v, o1);
+	if (has_miter)
+	{
+		poly[n++] = miter;
 	}
+	else if (join == ST_JOIN_ROUND)
+	{
+		// Outer normals, rotated from s1's towards s2's in steps small enough for the radius
+		int32_t sign = outer_a ? 1 : -1;
+		int32_t ux = sign * s1->nx, uy = sign * s1->ny;
+		int32_t tx = sign * s2->nx, ty = sign * s2->ny;
+		int16_t angle = (width <= 16) ? 45 : (width <= 64) ? 20 : 10;
+		int32_t c = _st_cos(angle), s = (turn > 0) ? _st_sin(angle) : -_st_sin(angle);
+		while (n < 23)
+		{
+			int32_t rx = (ux * c - uy * s) / 16384;
+			int32_t ry = (ux * s + uy * c) / 16384;
+			// Passed the normal of s2
+			if ((int64_t)(rx * ty - ry * tx) * turn <= 0)
+				break;
+			ux = rx;
+			uy = ry;
+			poly[n].x = v.x + _st_floor_div(ux * width + 16384, 32768);
+			poly[n].y = v.y + _st_floor_div(uy * width + 16384, 32768);
+			n++;
+		}
+	}
+	poly[n++] = _st_stroke_add(v, o2);
+	st_fill_polygon(disp, poly, n, color);
 }
 
+/*
+ * Fill a segment between its caps
+ */
+static void _st_stroke_fill_seg(st_display_t *disp, const st_stroke_cap_t *start, const st_stroke_cap_t *end, uint16_t color)
+{
+	st_point_t poly[6];
+	uint8_t n = 0;
+	poly[n++] = start->a;
+	poly[n++] = end->a;
+	if (end->has_mid)
+		poly[n++] = end->mid;
+	poly[n++] = end->b;
+	poly[n++] = start->b;
+	if (start->has_mid)
+		poly[n++] = start->mid;
+	st_fill_polygon(disp, poly, n, color);
+}
 
 
-/**
- * Renders a string by drawing each character glyph from the passed string.
- * Called by `st_draw_string()` and `st_draw_string_withbg()`.
- * Text is wrapped automatically if it hits the screen boundary.
- * x_padding and y_padding defines horizontal and vertical distance (in px) between two characters
- * is_bg=1 : Text will habe background color,   is_bg=0 : Text will have transparent background
- * User need NOT call it.
+/*
+ * Stroke a polyline, closed or not. Repeated points and the middle points of straight runs are
+ * skipped, so every segment is a different direction.
  */
-
-void _st_draw_string_main(uint16_t x, uint16_t y, char *str, uint16_t fore_color, uint16_t back_color, const tFont *font, uint8_t is_bg)
+static void _st_stroke(st_display_t *disp, const st_point_t *points, uint16_t n, uint8_t closed, uint8_t width, uint8_t join, uint16_t color)
 {
-	uint16_t x_temp = x;
-	uint16_t y_temp = y;
-
-	uint8_t x_padding = 0;
-	uint8_t y_padding = 0;
-	const tImage *img = NULL;
-	uint16_t width = 0, height = 0;
+	if (n == 0 || width == 0)
+		return;
 
+	// A closed polyline may repeat its first point at the end
+	while (closed && n > 1 && points[n - 1].x == points[0].x && points[n - 1].y == points[0].y)
+		n--;
 
+	uint16_t first = 0;
+	uint16_t second = _st_stroke_next(points, n, first);
+	if (second == n)
+	{
+		// Just a point
+		int16_t x = points[0].x - width / 2, y = points[0].y - width / 2;
+		_st_fill_area(disp, x, y, x + width - 1, y + width - 1, color);
+		return;
+	}
+	uint16_t last = second;
+	while (_st_stroke_next(points, n, last) != n)
+		last = _st_stroke_next(points, n, last);
+	// Closing a single segment would go back over it
+	if (last == second)
+		closed = 0;
 
-	while (*str)
+	if (width == 1)
 	{
-		if (*str == '\n')
+		uint16_t i = first;
+		uint16_t j = second;
+		while (j != n)
 		{
-			x_temp = x;					//go to first col
-			y_temp += (font->chars[0].image->height + y_padding);	//go to next row (row height = height of space)
+			_st_thin_segment(disp, points[i], points[j], i != first, 0, color);
+			i = j;
+			j = _st_stroke_next(points, n, j);
 		}
+		if (closed)
+			_st_thin_segment(disp, points[last], points[first], 1, 1, color);
+		return;
+	}
 
-		else if (*str == '\t')
+	st_stroke_seg_t seg, next;
+	st_stroke_cap_t start, end, first_end;
+	_st_stroke_seg_init(&seg, points[first], points[second], width);
+
+	// Caps at the first vertex
+	if (closed)
+	{
+		st_stroke_seg_t closing;
+		_st_stroke_seg_init(&closing, points[last], points[first], width);
+		_st_stroke_joint(disp, points[first], &closing, &seg, width, join, color, &first_end, &start);
+	}
+	else
+	{
+		start = _st_stroke_butt(points[first], &seg);
+	}
+
+	uint16_t j = second;
+	while (1)
+	{
+		// `seg` ends at j
+		if (j == first)
 		{
-			x_temp += 4 * (font->chars[0].image->height + y_padding);	//Skip 4 spaces (width = width of space)
+			// Closing segment
+			_st_stroke_fill_seg(disp, &start, &first_end, color);
+			return;
 		}
-		else
+
+		uint16_t k = _st_stroke_next(points, n, j);
+		if (k == n && closed)
+			k = first;
+		if (k == n)
 		{
-			for (uint8_t i = 0; i < font->length; i++)
-			{
-				if (font->chars[i].code == *str)
-				{
-					img = font->chars[i].image;
-					break;
-				}
-			}
-			// No glyph (img) found, so return from this function
-			if (img == NULL)
-			{
-				return;
-			}
+			end = _st_stroke_butt(points[j], &seg);
+			_st_stroke_fill_seg(disp, &start, &end, color);
+			return;
+		}
 
-			width = img->width;
-			height = img->height;
+		st_stroke_cap_t next_start;
+		_st_stroke_seg_init(&next, points[j], points[k], width);
+		_st_stroke_joint(disp, points[j], &seg, &next, width, join, color, &end, &next_start);
+		_st_stroke_fill_seg(disp, &start, &end, color);
+		start = next_start;
+		seg = next;
+		j = k;
+	}
+}
 
-			if(y_temp + (height + y_padding) > st_tftheight - 1)	//not enough space available at the bottom
-				return;
-			if (x_temp + (width + x_padding) > st_tftwidth - 1)	//not enough space available at the right side
-			{
-				x_temp = x;					//go to first col
-				y_temp += (height + y_padding);	//go to next row
-			}
 
+/**
+ * Draw connected lines through `points`. Unlike calling st_draw_line() for each segment,
+ * joint pixels are drawn once and straight runs of points are drawn as one line.
+ * A 1px polyline has the same pixels as st_draw_line(). A thicker one is centered on the points,
+ * with `join` at its corners and square (butt) ends.
+ * @param disp display
+ * @param points vertices, may be outside the display
+ * @param n number of vertices
+ * @param width width or thickness of the lines
+ * @param join ST_JOIN_MITER, ST_JOIN_BEVEL or ST_JOIN_ROUND. Miters longer than 2 x `width` are beveled.
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_polyline(st_display_t *disp, const st_point_t *points, uint16_t n, uint8_t width, uint8_t join, uint16_t color)
+{
+	_st_stroke(disp, points, n, 0, width, join, color);
+}
 
-			if (is_bg)
-				_st_render_glyph(x_temp, y_temp, fore_color, back_color, img, 1);
-			else
-				_st_render_glyph(x_temp, y_temp, fore_color, back_color, img, 0);
-			x_temp += (width + x_padding);		//next char position
-		}
 
+/**
+ * Start an empty path. Its points are stored in `buffer`.
+ * Subpaths take one more point of the buffer each (see st_path_move_to() and st_path_close()).
+ * @param path path
+ * @param buffer room for the points
+ * @param len number of points in `buffer`
+ */
+void st_path_init(st_path_t *path, st_point_t *buffer, uint16_t len)
+{
+	path->points = buffer;
+	path->len = len;
+	path->n = 0;
+	path->start = 0;
+}
 
-		str++;
-	}
+/*
+ * Add a point (or a subpath end marker) to a path
+ */
+static uint8_t _st_path_add(st_path_t *path, int16_t x, int16_t y)
+{
+	if (path->n == path->len)
+		return 0;
+	path->points[path->n].x = x;
+	path->points[path->n].y = y;
+	path->n++;
+	return 1;
 }
 
+/**
+ * Start a new subpath at (x,y)
+ * @param path path
+ * @param x column address
+ * @param y row address
+ * @return 0 if the buffer of the path is full, else 1
+ */
+uint8_t st_path_move_to(st_path_t *path, int16_t x, int16_t y)
+{
+	// End the open subpath
+	if (path->n > path->start && !_st_path_add(path, ST_PATH_END, 0))
+		return 0;
+	path->start = path->n;
+	return _st_path_add(path, x, y);
+}
 
 /**
- * Draws a character at a given position, fore color, back color.
- * @param x Start col address
- * @param y Start row address
- * @param character the ASCII character to be drawn
- * @param fore_color foreground color
- * @param back_color background color
- * @param font Pointer to the font of the character
- * @param is_bg Defines if character has background or not (transparent)
+ * Add a line from the last point to (x,y)
+ * @param path path
+ * @param x column address
+ * @param y row address
+ * @return 0 if the buffer of the path is full, else 1
  */
-void st_draw_char(uint16_t x, uint16_t y, char character, uint16_t fore_color, uint16_t back_color, const tFont *font, uint8_t is_bg)
+uint8_t st_path_line_to(st_path_t *path, int16_t x, int16_t y)
 {
-	const tImage *img = NULL;
-	for (uint8_t i = 0; i < font->length; i++)
+	return _st_path_add(path, x, y);
+}
+
+/**
+ * Close the subpath with a line back to its first point, and join its ends
+ * @param path path
+ * @return 0 if the buffer of the path is full, else 1
+ */
+uint8_t st_path_close(st_path_t *path)
+{
+	if (path->n == path->start)
+		return 1;
+	if (!_st_path_add(path, ST_PATH_END, 1))
+		return 0;
+	path->start = path->n;
+	return 1;
+}
+
+/**
+ * Draw the lines of a path. Every subpath is drawn like st_draw_polyline(), and closed ones are
+ * joined at their first point too.
+ * @param disp display
+ * @param path path
+ * @param width width or thickness of the lines
+ * @param join ST_JOIN_MITER, ST_JOIN_BEVEL or ST_JOIN_ROUND
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_path(st_display_t *disp, const st_path_t *path, uint8_t width, uint8_t join, uint16_t color)
+{
+	uint16_t start = 0;
+	for (uint16_t i = 0; i <= path->n; i++)
 	{
-		if (font->chars[i].code == character)
+		if (i == path->n || path->points[i].x == ST_PATH_END)
 		{
-			img = font->chars[i].image;
-			break;
+			uint8_t closed = (i < path->n) ? path->points[i].y : 0;
+			_st_stroke(disp, &path->points[start], i - start, closed, width, join, color);
+			start = i + 1;
 		}
 	}
-	// No glyph (img) found, so return from this function
-	if (img == NULL)
+}
+
+
+/*
+ * Bezier curves are halved (de Casteljau) until every piece is flat enough to be drawn as one line,
+ * so flat parts of a curve are halved fewer times than tight bends.
+ * Control points are kept in 1/256 px. A quadratic curve uses the first 3 points.
+ */
+typedef struct
+{
+	int32_t x[4];
+	int32_t y[4];
+} st_bezier_t;
+
+/*
+ * Length of (dx,dy), underestimated by up to 8%
+ */
+static int32_t _st_bezier_len(int32_t dx, int32_t dy)
+{
+	dx = (dx < 0) ? -dx : dx;
+	dy = (dy < 0) ? -dy : dy;
+	int32_t axis = (dx > dy) ? dx : dy;
+	int32_t diagonal = (int32_t)(((int64_t)(dx + dy) * 181) >> 8);	// (|dx| + |dy|) / sqrt(2)
+	return (diagonal > axis) ? diagonal : axis;
+}
+
+/*
+ * Is every point of the curve within ST_BEZIER_TOLERANCE of the line between its end points?
+ * A quadratic curve is at most half as far from that line as its control point, a cubic one
+ * at most 3/4 as far as its farthest control point. The control points must also lie between
+ * the end points, else the curve overshoots the line.
+ */
+static uint8_t _st_bezier_flat(const st_bezier_t *b, uint8_t order)
+{
+	int32_t dx = b->x[order] - b->x[0];
+	int32_t dy = b->y[order] - b->y[0];
+	int64_t len2 = (int64_t)dx * dx + (int64_t)dy * dy;
+	// Distance * length, in 1/256 px^2, that meets the tolerance (x 3 for cubic curves)
+	int64_t limit = (int64_t)ST_BEZIER_TOLERANCE * 16 * ((order == 2) ? 2 : 4) * _st_bezier_len(dx, dy);
+
+	for (uint8_t i = 1; i < order; i++)
 	{
-		return;
+		int32_t px = b->x[i] - b->x[0];
+		int32_t py = b->y[i] - b->y[0];
+		int64_t dot = (int64_t)px * dx + (int64_t)py * dy;
+		int64_t cross = (int64_t)px * dy - (int64_t)py * dx;
+		if (cross < 0)
+			cross = -cross;
+		if (len2 == 0)
+		{
+			if (px != 0 || py != 0)
+				return 0;
+		}
+		else if (dot < 0 || dot > len2 || cross * ((order == 2) ? 1 : 3) > limit)
+			return 0;
 	}
+	return 1;
+}
 
-	if (is_bg)
-		_st_render_glyph(x, y, fore_color, back_color, img, 1);
-	else
-		_st_render_glyph(x, y, fore_color, back_color, img, 0);
+/*
+ * Halve a curve at t = 1/2. `b` keeps the first half, `right` gets the second.
+ */
+static void _st_bezier_split_coord(int32_t *c, int32_t *right, uint8_t order)
+{
+	// Each pass averages neighbouring points. The last point of each pass belongs to `right`.
+	right[order] = c[order];
+	for (uint8_t pass = 1; pass <= order; pass++)
+	{
+		for (uint8_t i = order; i >= pass; i--)
+			c[i] = (c[i - 1] + c[i]) >> 1;
+		right[order - pass] = c[order];
+	}
 }
 
+static void _st_bezier_split(st_bezier_t *b, st_bezier_t *right, uint8_t order)
+{
+	_st_bezier_split_coord(b->x, right->x, order);
+	_st_bezier_split_coord(b->y, right->y, order);
+}
 
-/**
- * Draws a string on the display with `font` and `color` at given position.
- * Background of this string is transparent
- * @param x Start col address
- * @param y Start y address
- * @param str pointer to the string to be drawn
- * @param color 16-bit RGB565 color of the string
- * @param font Pointer to the font of the string
+/*
+ * Draw a quadratic (3 points) or cubic (4 points) curve as a polyline
  */
-void st_draw_string(uint16_t x, uint16_t y, char *str, uint16_t color, const tFont *font)
+static void _st_bezier(st_display_t *disp, const st_point_t *points, uint8_t order, uint8_t width, uint16_t color)
 {
-	_st_draw_string_main(x, y, str, color, 0, font, 0);
+	st_bezier_t cur, stack[ST_BEZIER_DEPTH];	// pieces still to be drawn, the last one is next
+	uint8_t depth[ST_BEZIER_DEPTH];
+	st_point_t line[(1 << ST_BEZIER_DEPTH) + 1];
+	uint16_t n = 0, sp = 0;
+	uint8_t d = 0;
+
+	for (uint8_t i = 0; i <= order; i++)
+	{
+		cur.x[i] = (int32_t)points[i].x * 256;
+		cur.y[i] = (int32_t)points[i].y * 256;
+	}
+	line[n++] = points[0];
+
+	while (1)
+	{
+		if (d < ST_BEZIER_DEPTH && !_st_bezier_flat(&cur, order))
+		{
+			_st_bezier_split(&cur, &stack[sp], order);
+			depth[sp++] = ++d;
+			continue;
+		}
+		line[n].x = (int16_t)((cur.x[order] + 128) >> 8);
+		line[n].y = (int16_t)((cur.y[order] + 128) >> 8);
+		n++;
+		if (sp == 0)
+			break;
+		cur = stack[--sp];
+		d = depth[sp];
+	}
+	st_draw_polyline(disp, line, n, width, ST_JOIN_MITER, color);
 }
 
+/**
+ * Draw a quadratic Bezier curve from (x0,y0) to (x2,y2), pulled toward the control point (x1,y1).
+ * The curve is drawn with st_draw_polyline() as the fewest lines that stay within
+ * ST_BEZIER_TOLERANCE of it. No floating point math is used.
+ * @param disp display
+ * @param x0 start column address
+ * @param y0 start row address
+ * @param x1 control point column address
+ * @param y1 control point row address
+ * @param x2 end column address
+ * @param y2 end row address
+ * @param width width or thickness of the curve
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_bezier2(st_display_t *disp, int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t width, uint16_t color)
+{
+	const st_point_t points[3] = {{x0, y0}, {x1, y1}, {x2, y2}};
+	_st_bezier(disp, points, 2, width, color);
+}
 
 /**
- * Draws a string on the display with `font`, `fore_color`, and `back_color` at given position.
- * The string has background color
- * @param x Start col address
- * @param y Start y address
- * @param str pointer to the string to be drawn
- * @param foe_color 16-bit RGB565 color of the string
- * @param back_color 16-bit RGB565 color of the string's background
- * @param font Pointer to the font of the string
+ * Draw a cubic Bezier curve from (x0,y0) to (x3,y3), leaving in the direction of (x1,y1)
+ * and arriving from the direction of (x2,y2). Drawn like st_draw_bezier2().
+ * @param disp display
+ * @param x0 start column address
+ * @param y0 start row address
+ * @param x1 first control point column address
+ * @param y1 first control point row address
+ * @param x2 second control point column address
+ * @param y2 second control point row address
+ * @param x3 end column address
+ * @param y3 end row address
+ * @param width width or thickness of the curve
+ * @param color 16-bit RGB565 color
  */
-void st_draw_string_withbg(uint16_t x, uint16_t y, char *str, uint16_t fore_color, uint16_t back_color, const tFont *font)
+void st_draw_bezier3(st_display_t *disp, int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint8_t width, uint16_t color)
 {
-	_st_draw_string_main(x, y, str, fore_color, back_color, font, 1);
+	const st_point_t points[4] = {{x0, y0}, {x1, y1}, {x2, y2}, {x3, y3}};
+	_st_bezier(disp, points, 3, width, color);
 }
 
 
-/**
- * Draw a bitmap image on the display
- * @param x Start col address
- * @param y Start row address
- * @param bitmap Pointer to the image data to be drawn
+/*
+ * Gradient fills. The color at position `t` (0 - t_max) is interpolated per channel in 16.16
+ * fixed point, so the fraction below one RGB565 step is known and can be dithered away.
+ */
+typedef struct
+{
+	uint8_t type;				// ST_GRADIENT_VERTICAL, ST_GRADIENT_HORIZONTAL or ST_GRADIENT_RADIAL
+	uint8_t dither;				// 1 to dither with a 4x4 Bayer matrix instead of rounding
+	uint16_t w, h;				// size of the whole rectangle
+	int32_t base[3];			// red, green, blue of color1
+	int32_t step[3];			// change of red, green, blue per unit of `t`
+} st_gradient_t;
+
+static void _st_gradient_init(st_gradient_t *g, uint16_t color1, uint16_t color2, uint32_t t_max)
+{
+	static const uint8_t shift[3] = {11, 5, 0};
+	static const uint8_t mask[3] = {0x1F, 0x3F, 0x1F};
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		int32_t c1 = (color1 >> shift[i]) & mask[i];
+		int32_t c2 = (color2 >> shift[i]) & mask[i];
+		g->base[i] = c1 * 65536;
+		// Truncated towards zero, so the color never goes past color2
+		g->step[i] = t_max ? (c2 - c1) * 65536 / (int32_t)t_max : 0;
+	}
+}
+
+/*
+ * Color at position `t`. `bias` (0 - 65535) is added to the fractions before truncating them.
  */
+static uint16_t _st_gradient_color(const st_gradient_t *g, uint32_t t, int32_t bias)
+{
+	uint16_t r = (g->base[0] + g->step[0] * (int32_t)t + bias) >> 16;
+	uint16_t gr = (g->base[1] + g->step[1] * (int32_t)t + bias) >> 16;
+	uint16_t b = (g->base[2] + g->step[2] * (int32_t)t + bias) >> 16;
+	return (r << 11) | (gr << 5) | b;
+}
 
-void st_draw_bitmap(uint16_t x, uint16_t y, const tImage *bitmap)
+/*
+ * Generate `n` pixels of row `v` of the rectangle, from column `u`.
+ * `sx`, `sy` is the screen position of the first one, so dithering lines up across calls.
+ */
+static void _st_gradient_span(const st_gradient_t *g, uint16_t *buf, uint16_t u, uint16_t v, uint16_t n, uint16_t sx, uint16_t sy)
 {
-	uint16_t width = 0, height = 0;
-	width = bitmap->width;
-	height = bitmap->height;
-	st_set_address_window(x, y, x + width-1, y + height-1);
+	static const uint8_t bayer[4][4] =
+	{
+		{0, 8, 2, 10},
+		{12, 4, 14, 6},
+		{3, 11, 1, 9},
+		{15, 7, 13, 5},
+	};
+	const uint8_t *thresholds = bayer[sy & 3];
 
-	#ifdef ST_RELEASE_WHEN_IDLE
-		ST_CS_ACTIVE;
-	#endif
-	ST_DC_DAT;
+	// Radial: `t` is the distance from the center in 1/4 pixels. Its square `d` is kept exactly,
+	// and the root follows it by a few steps per pixel.
+	int32_t ex = 2 * (int32_t)u - (g->w - 1);
+	int32_t ey = 2 * (int32_t)v - (g->h - 1);
+	int32_t d = 4 * (ex * ex + ey * ey);
+	uint32_t r = (g->type == ST_GRADIENT_RADIAL) ? _st_isqrt(d) : 0;
 
-	#ifdef ST_USE_SPI_DMA
-		uint32_t bytes_to_write = width * height * 2;
-		uint16_t transfer_size = ST_BUFFER_SIZE_BYTES;
-		uint32_t src_start_address = 0;
+	for (uint16_t i = 0; i < n; i++)
+	{
+		uint32_t t;
+		if (g->type == ST_GRADIENT_VERTICAL)
+			t = v;
+		else if (g->type == ST_GRADIENT_HORIZONTAL)
+			t = u + i;
+		else
+			t = r;
 
-		while (bytes_to_write)
-		{
-			transfer_size = (bytes_to_write < transfer_size) ? bytes_to_write : transfer_size;
-			_st_write_spi_dma((void *)(&bitmap->data[src_start_address]), transfer_size);
-			src_start_address += ST_BUFFER_SIZE_BYTES;
-			bytes_to_write -= transfer_size;
-		}
-		
-	#else
+		int32_t bias = g->dither ? thresholds[(sx + i) & 3] * 4096 + 2048 : 32768;
+		buf[i] = _st_gradient_color(g, t, bias);
 
-		uint32_t total_pixels = width * height;
-		for (uint16_t pixels = 0; pixels < total_pixels; pixels++)
+		if (g->type == ST_GRADIENT_RADIAL)
 		{
-			ST_WRITE_8BIT((uint8_t)(bitmap->data[2*pixels]));
-			ST_WRITE_8BIT((uint8_t)(bitmap->data[2*pixels + 1]));
+			d += 16 * ex + 16;
+			ex += 2;
+			while ((r + 1) * (r + 1) <= (uint32_t)d)
+				r++;
+			while (r * r > (uint32_t)d)
+				r--;
 		}
-
-	#endif
-
-	#ifdef ST_RELEASE_WHEN_IDLE
-		ST_CS_IDLE;
-	#endif
+	}
 }
 
 
 /**
- * Fills `len` number of pixels with `color`.
- * Call st_set_address_window() before calling this function.
- * @param color 16-bit RGB565 color value
- * @param len 32-bit number of pixels
+ * Fill a rectangle with a gradient from `color1` to `color2`.
+ * Vertical: color1 at the top row, color2 at the bottom row.
+ * Horizontal: color1 at the left column, color2 at the right column.
+ * Radial: color1 at the center, color2 at the corners.
+ * The whole rectangle is one address window. Generated lines go through two buffers in turn,
+ * so the next one is generated while the last one is sent. Rows of one color (vertical)
+ * and repeated rows (horizontal) are not generated at all, unless dithered.
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ * @param w Width of rectangle
+ * @param h Height of rectangle
+ * @param color1 16-bit RGB565 color at the start
+ * @param color2 16-bit RGB565 color at the end
+ * @param type ST_GRADIENT_VERTICAL, ST_GRADIENT_HORIZONTAL or ST_GRADIENT_RADIAL.
+ *        Add ST_GRADIENT_DITHER to hide the steps between RGB565 colors.
  */
-
-void st_fill_color(uint16_t color, uint32_t len)
+void st_fill_gradient_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color1, uint16_t color2, uint8_t type)
 {
-	#ifdef ST_RELEASE_WHEN_IDLE
-		ST_CS_ACTIVE;
-	#endif
-	ST_DC_DAT;
-	uint8_t color_high = color >> 8;
-	uint8_t color_low = color;
+	int16_t x1 = x, y1 = y;
+	int16_t x2 = x + w - 1, y2 = y + h - 1;
+	if (w == 0 || h == 0 || !_st_clip(disp, &x1, &y1, &x2, &y2))
+		return;
 
-	#ifdef ST_USE_SPI_DMA		
-		uint8_t disp_buffer[ST_BUFFER_SIZE_BYTES];
-		for (uint16_t i = 0; i < ST_BUFFER_SIZE_BYTES; i = i+2)
-		{
-			disp_buffer[i] = color_high;
-			disp_buffer[i + 1] = color_low;
-		}
+	st_gradient_t g;
+	g.type = type & ~ST_GRADIENT_DITHER;
+	g.dither = (type & ST_GRADIENT_DITHER) ? 1 : 0;
+	g.w = w;
+	g.h = h;
+	if (g.type == ST_GRADIENT_VERTICAL)
+		_st_gradient_init(&g, color1, color2, h - 1);
+	else if (g.type == ST_GRADIENT_HORIZONTAL)
+		_st_gradient_init(&g, color1, color2, w - 1);
+	else
+		_st_gradient_init(&g, color1, color2, _st_isqrt(4 * ((uint32_t)(w - 1) * (w - 1) + (uint32_t)(h - 1) * (h - 1))));
+
+	// Visible part: its size, and its position in the rectangle
+	uint16_t cw = x2 - x1 + 1;
+	uint16_t ch = y2 - y1 + 1;
+	uint16_t u0 = x1 - ((int16_t)x + disp->origin_x);
+	uint16_t v0 = y1 - ((int16_t)y + disp->origin_y);
+	uint16_t half = ST_PIXBUF_LEN / 2;
 
-		// len is pixel count. But each pixel is 2 bytes. So, multiply by 2
-		uint32_t bytes_to_write = len * 2;
-		uint16_t transfer_size = ST_BUFFER_SIZE_BYTES;
-		while (bytes_to_write)
+	// Rows of one color. Equal rows are filled together.
+	if (g.type == ST_GRADIENT_VERTICAL && !g.dither)
+	{
+		#ifdef ST_USE_DISPLAY_LIST
+			uint8_t recording = disp->dlist_recording;
+		#else
+			uint8_t recording = 0;
+		#endif
+		if (!recording)
+			st_set_address_window(disp, x1, y1, x2, y2);
+
+		uint16_t v = 0;
+		while (v < ch)
 		{
-			transfer_size = (bytes_to_write < transfer_size) ? bytes_to_write : transfer_size;
-			_st_write_spi_dma(disp_buffer, transfer_size);
-			bytes_to_write -= transfer_size;
+			uint16_t color = _st_gradient_color(&g, v0 + v, 32768);
+			uint16_t rows = 1;
+			while (v + rows < ch && _st_gradient_color(&g, v0 + v + rows, 32768) == color)
+				rows++;
+
+			if (recording)
+				_st_draw_rect(disp, x1, y1 + v, cw, rows, color);
+			else
+				st_queue_fill(disp, color, (uint32_t)cw * rows);
+			v += rows;
 		}
+		return;
+	}
+
+	st_set_address_window(disp, x1, y1, x2, y2);
 
-	#else
-		/*
-		* Here, macros are directly called (instead of inline functions) for performance increase
-		*/
-		uint16_t blocks = (uint16_t)(len / 64); // 64 pixels/block
-		uint8_t  pass_count;
+	// Every row is the same. One buffer of as many rows as fit is generated once, and sent again.
+	if (g.type == ST_GRADIENT_HORIZONTAL && !g.dither && cw <= half)
+	{
+		uint16_t rows = half / cw;
+		if (rows > ch)
+			rows = ch;
+		uint16_t *buf = _st_pixbuf_get(disp, cw * rows);
+		_st_gradient_span(&g, buf, u0, v0, cw, x1, y1);
+		for (uint16_t i = cw; i < cw * rows; i++)
+			buf[i] = buf[i - cw];
 
-		// Write first pixel
-		ST_WRITE_8BIT(color_high); ST_WRITE_8BIT(color_low);
-		len--;
+		for (uint16_t v = 0; v < ch; v += rows)
+			st_queue_data16(disp, buf, (uint32_t)cw * (ch - v < rows ? ch - v : rows));
+		return;
+	}
 
-		while(blocks--)
+	// Generate rows. Narrow rows are grouped to fill a buffer, wide rows are cut to fit one.
+	uint16_t v = 0;
+	while (v < ch)
+	{
+		if (cw <= half)
 		{
-			pass_count = 16;
-			while(pass_count--)
-			{
-				ST_WRITE_8BIT(color_high); ST_WRITE_8BIT(color_low); 	ST_WRITE_8BIT(color_high); ST_WRITE_8BIT(color_low); //2
-				ST_WRITE_8BIT(color_high); ST_WRITE_8BIT(color_low); 	ST_WRITE_8BIT(color_high); ST_WRITE_8BIT(color_low); //4
-			}
+			uint16_t rows = half / cw;
+			if (rows > ch - v)
+				rows = ch - v;
+			uint16_t *buf = _st_pixbuf_get(disp, cw * rows);
+			for (uint16_t k = 0; k < rows; k++)
+				_st_gradient_span(&g, buf + k * cw, u0, v0 + v + k, cw, x1, y1 + v + k);
+			st_queue_data16(disp, buf, cw * rows);
+			v += rows;
 		}
-		pass_count = len & 63;
-		while (pass_count--)
+		else
 		{
-			// write here the remaining data
-			ST_WRITE_8BIT(color_high); ST_WRITE_8BIT(color_low);
+			for (uint16_t i = 0; i < cw; i += half)
+			{
+				uint16_t n = cw - i < half ? cw - i : half;
+				uint16_t *buf = _st_pixbuf_get(disp, n);
+				_st_gradient_span(&g, buf, u0 + i, v0 + v, n, x1 + i, y1 + v);
+				st_queue_data16(disp, buf, n);
+			}
+			v++;
 		}
-		
-	#endif
+	}
+}
 
-	#ifdef ST_RELEASE_WHEN_IDLE
-		ST_CS_IDLE;
-	#endif
+
+/*
+ * Copy `n` pixels of row `v` of a tiled pattern, from column `u`
+ */
+static void _st_pattern_span(const uint16_t *tile, uint8_t tile_w, uint8_t tile_h, uint16_t *buf, uint16_t u, uint16_t v, uint16_t n)
+{
+	const uint16_t *row = tile + (v % tile_h) * tile_w;
+	uint8_t i = u % tile_w;
+	while (n--)
+	{
+		*buf++ = row[i];
+		if (++i == tile_w)
+			i = 0;
+	}
 }
 
 
 /**
- * Fills a rectangular area with `color`.
- * Before filling, performs area bound checking
+ * Fill a rectangle with copies of a small pattern tile (checkerboard, hatching, stripes...).
+ * The top left corner of the rectangle gets the top left pixel of the tile.
+ * The rectangle is cut into vertical strips whose data repeats every `tile_h` rows. One copy of
+ * that data is built, and each strip is sent from it by one circular DMA transfer. So the work
+ * does not grow with the height. Only the last rows (less than `tile_h`) are built row by row.
+ * Strips are widest if `tile_w * tile_h` is small compared to ST_PIXBUF_LEN / 2. Larger tiles
+ * are built row by row.
+ * The tile is copied, so it can be changed as soon as the function returns.
+ * @param disp display
  * @param x Start col address
  * @param y Start row address
  * @param w Width of rectangle
  * @param h Height of rectangle
- * @param color 16-bit RGB565 color
+ * @param tile `tile_w` x `tile_h` RGB565 pixels, row by row
+ * @param tile_w width of the tile
+ * @param tile_h height of the tile
  */
-void st_fill_rect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+void st_fill_pattern_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t *tile, uint8_t tile_w, uint8_t tile_h)
 {
-	if (x >= st_tftwidth || y >= st_tftheight || w == 0 || h == 0)
+	int16_t x1 = x, y1 = y;
+	int16_t x2 = x + w - 1, y2 = y + h - 1;
+	if (w == 0 || h == 0 || tile_w == 0 || tile_h == 0 || !_st_clip(disp, &x1, &y1, &x2, &y2))
 		return;
-	if (x + w - 1 >= st_tftwidth)
-		w = st_tftwidth - x;
-	if (y + h - 1 >= st_tftheight)
-		h = st_tftheight - y;
 
-	st_set_address_window(x, y, x + w - 1, y + h - 1);
-	st_fill_color(color, (uint32_t)w * (uint32_t)h);
+	// Visible part: its size, and its position in the rectangle
+	uint16_t cw = x2 - x1 + 1;
+	uint16_t ch = y2 - y1 + 1;
+	uint16_t u0 = x1 - ((int16_t)x + disp->origin_x);
+	uint16_t v0 = y1 - ((int16_t)y + disp->origin_y);
+	uint16_t half = ST_PIXBUF_LEN / 2;
+
+	// Strips: whole tiles wide, as many as fit in a buffer of `tile_h` rows.
+	// Every strip starts at the same column of the tile, so they all send the same data.
+	uint16_t strip_w = (half / tile_h) / tile_w * tile_w;
+	if (strip_w > cw)
+		strip_w = cw;
+	uint16_t strip_h = ch - ch % tile_h;
+	if (strip_w == 0)
+		strip_h = 0;
+
+	uint16_t *buf = NULL;
+	uint16_t u = 0;
+	while (u < cw && strip_h)
+	{
+		uint16_t sw = (cw - u < strip_w) ? cw - u : strip_w;
+		st_set_address_window(disp, x1 + u, y1, x1 + u + sw - 1, y1 + strip_h - 1);
+
+		// Only the first strip and a narrower last one need new data
+		if (u == 0 || sw != strip_w)
+		{
+			buf = _st_pixbuf_get(disp, sw * tile_h);
+			for (uint8_t r = 0; r < tile_h; r++)
+				_st_pattern_span(tile, tile_w, tile_h, buf + r * sw, u0 + u, v0 + r, sw);
+		}
+		_st_queue_repeat(disp, buf, sw * tile_h, (uint32_t)sw * strip_h);
+		u += sw;
+	}
+
+	// Rows left below the strips
+	if (strip_h == ch)
+		return;
+	st_set_address_window(disp, x1, y1 + strip_h, x2, y2);
+	for (uint16_t v = strip_h; v < ch; v++)
+	{
+		for (uint16_t i = 0; i < cw; i += half)
+		{
+			uint16_t n = cw - i < half ? cw - i : half;
+			buf = _st_pixbuf_get(disp, n);
+			_st_pattern_span(tile, tile_w, tile_h, buf, u0 + i, v0 + v, n);
+			st_queue_data16(disp, buf, n);
+		}
+	}
 }
 
 
 /*
- * Same as `st_fill_rect()` but does not do bound checking, so it's slightly faster
+ * Read pixels x1 - x2 of row y back from the panel into `out` (RGB565).
+ * RAMRD is written as usual, then SPI is turned around (bidirectional mode, receiving) to clock in
+ * the answer on the same SDA line, at ST_READ_BAUDRATE. The controller sends one dummy bit, then
+ * 3 bytes per pixel with 6 bits per color at the top. Only CS high ends the read, so the display
+ * needs a CS pin.
  */
-void st_fill_rect_fast(uint16_t x1, uint16_t y1, uint16_t w, uint16_t h, uint16_t color)
+static void _st_read_pixels(st_display_t *disp, uint16_t x1, uint16_t x2, uint16_t y, uint16_t *out)
 {
-	st_set_address_window(x1, y1, x1 + w - 1, y1 + h - 1);
-	st_fill_color(color, (uint32_t)w * (uint32_t)h);
+	uint32_t spi = disp->spi;
+	uint32_t n_bytes = (uint32_t)(x2 - x1 + 1) * 3 + 1;	// pixels are one bit late
+	// Core clock cycles in one SPI clock while reading
+	uint32_t apb = (spi == SPI1) ? rcc_apb2_frequency : rcc_apb1_frequency;
+	uint32_t sck_cycles = (2u << (ST_READ_BAUDRATE >> 3)) * (rcc_ahb_frequency / apb);
+
+	_st_set_window(disp, x1, y, x2, y);
+	st_wait_idle(disp);
+	#ifdef ST_RELEASE_WHEN_IDLE
+		ST_CS_ACTIVE(disp);
+	#endif
+	_st_spi_set_16bit(disp, 0);
+	_st_set_dc(disp, 0);
+	ST_WRITE_8BIT(spi, ST7789_RAMRD);
+	_st_set_dc(disp, 1);
+	disp->win_ramwr_open = 0;
+
+	// Receiving starts the clock as soon as SPI is enabled, so turn around once RAMRD is out
+	ST_WAIT_SPI_IDLE(spi);
+	uint32_t cr1 = SPI_CR1(spi);
+	SPI_CR1(spi) = cr1 & ~SPI_CR1_SPE;
+	SPI_CR1(spi) = (cr1 & ~(SPI_CR1_SPE | SPI_CR1_BIDIOE | SPI_CR1_BAUDRATE_FPCLK_DIV_256)) | ST_READ_BAUDRATE;
+	SPI_CR1(spi) |= SPI_CR1_SPE;
+
+	uint8_t last = 0, rgb[3];
+	for (uint32_t i = 0; i < n_bytes; i++)
+	{
+		while (!(SPI_SR(spi) & SPI_SR_RXNE));
+		uint8_t b = (uint8_t)SPI_DR(spi);
+		// Stopping a bidirectional receive (RM0008): after the second to last byte, wait one SPI
+		// clock and disable SPI. The clock then stops after the last byte, which is waited for below.
+		if (i == n_bytes - 2)
+		{
+			_st_delay_cycles(sck_cycles);
+			SPI_CR1(spi) &= ~SPI_CR1_SPE;
+		}
+		if (i)
+		{
+			uint32_t k = i - 1;
+			rgb[k % 3] = (uint8_t)((last << 1) | (b >> 7));
+			if (k % 3 == 2)
+				out[k / 3] = (uint16_t)((rgb[0] >> 3) << 11) | (uint16_t)((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+		}
+		last = b;
+	}
+
+	// The panel drives SDA until CS goes high, then SPI can transmit again
+	ST_CS_IDLE(disp);
+	SPI_CR1(spi) = cr1 & ~SPI_CR1_SPE;
+	SPI_CR1(spi) = cr1;
+	#ifndef ST_RELEASE_WHEN_IDLE
+		ST_CS_ACTIVE(disp);
+	#endif
 }
 
 
-/**
- * Fill the entire display (screen) with `color`
- * @param color 16-bit RGB565 color
+/*
+ * Flood fill.
+ * Spans are found and filled row by row (Heckbert's seed fill): a filled span of row y is queued
+ * for scanning the next row in the same direction, and the parts of it sticking out past the row
+ * it came from for scanning back. Rows are looked at through a small cache of bit masks, so a row
+ * is read from the panel (or the shadow) once while it's in use. Filled spans are sent as fills,
+ * spans of the same columns on consecutive rows together as one rectangle.
  */
-void st_fill_screen(uint16_t color)
+#define ST_FLOOD_ROWS		3		// rows y - 1, y and y + 1 are in use at a time
+#define ST_FLOOD_ROW_BYTES	40		// 320 px, the longest side of an ST7789
+
+typedef struct
 {
-	st_set_address_window(0, 0, st_tftwidth - 1, st_tftheight - 1);
-	st_fill_color(color, (uint32_t)st_tftwidth * (uint32_t)st_tftheight);
-}
+	int16_t y;						// row the span was found in
+	int16_t x1, x2;
+	int8_t dy;						// row to scan is y + dy
+} st_flood_span_t;
 
+typedef struct
+{
+	st_display_t *disp;
+	int16_t x1, y1, x2, y2;			// clip rectangle
+	uint16_t old_color;				// color (or shadow key) of the region
+	uint16_t new_color;				// color (or shadow key) of the fill
+	uint16_t color;
+	uint8_t use_shadow;
+	int16_t row_y[ST_FLOOD_ROWS];	// cached rows
+	uint8_t match[ST_FLOOD_ROWS][ST_FLOOD_ROW_BYTES];	// 1: in the region and not filled yet
+	uint8_t filled[ST_FLOOD_ROWS][ST_FLOOD_ROW_BYTES];	// 1: has the fill color
+	st_flood_span_t stack[ST_FLOOD_STACK];
+	uint16_t sp;
+	uint8_t overflow;				// spans didn't fit in the stack
+	uint8_t seen[ST_FLOOD_ROW_BYTES];	// 1: row was read before
+	uint8_t clean[ST_FLOOD_ROW_BYTES];	// 1: row had no pixels of the fill color when first read
+	int16_t lost_x1, lost_y1, lost_x2, lost_y2;	// bounds of those spans and the rows they scan
+	int16_t rect_x1, rect_y1, rect_x2, rect_y2;	// filled spans not sent yet
+	uint8_t rect;
+} st_flood_t;
 
-/**
- * Draw a rectangle
-*/
-void st_draw_rectangle(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+/*
+ * Send the filled spans that are waiting
+ */
+static void _st_flood_send(st_flood_t *f)
 {
-	// Perform bound checking
-	if (x >= st_tftwidth || y >= st_tftheight || w == 0 || h == 0)
+	if (!f->rect)
 		return;
-	if (x + w - 1 >= st_tftwidth)
-		w = st_tftwidth - x;
-	if (y + h - 1 >= st_tftheight)
-		h = st_tftheight - y;
-
-	_st_draw_fast_h_line(x, y, x+w-1, 1, color);
-	_st_draw_fast_h_line(x, y+h, x+w-1, 1, color);
-	_st_draw_fast_v_line(x, y, y+h-1, 1, color);
-	_st_draw_fast_v_line(x+w, y, y+h-1, 1, color);
-
-
+	_st_draw_rect(f->disp, f->rect_x1, f->rect_y1, f->rect_x2 - f->rect_x1 + 1, f->rect_y2 - f->rect_y1 + 1, f->color);
+	f->rect = 0;
 }
 
 /*
- * Called by st_draw_line().
- * User need not call it
+ * Cache slot of row `y`, read from the panel or the shadow if it's not cached
  */
-void _st_plot_line_low(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color)
+static uint8_t _st_flood_row(st_flood_t *f, int16_t y)
 {
-	int16_t dx = x1 - x0;
-	int16_t dy = y1 - y0;
-	int8_t yi = 1;
-	uint8_t pixels_per_point = width * width;	//no of pixels making a point. if line width is 1, this var is 1. if 2, this var is 4 and so on
-	uint8_t color_high = (uint8_t)(color >> 8);
-	uint8_t color_low = (uint8_t)color;
-	if (dy < 0)
+	uint8_t slot = (uint16_t)y % ST_FLOOD_ROWS;
+	if (f->row_y[slot] == y)
+		return slot;
+
+	// Filled spans must be on the panel (and in the shadow) before the row is read
+	_st_flood_send(f);
+	f->row_y[slot] = y;
+	for (uint8_t i = 0; i < ST_FLOOD_ROW_BYTES; i++)
 	{
-		yi = -1;
-		dy = -dy;
+		f->match[slot][i] = 0;
+		f->filled[slot][i] = 0;
 	}
 
-	int16_t D = 2*dy - dx;
-	uint16_t y = y0;
-	uint16_t x = x0;
-
-	while (x <= x1)
+	uint16_t *pixels = f->disp->pixbuf;
+	for (int16_t x = f->x1; x <= f->x2; x++)
 	{
-		st_set_address_window(x, y, x+width-1, y+width-1);
-		//Drawing all the pixels of a single point
-
-		#ifdef ST_RELEASE_WHEN_IDLE
-			ST_CS_ACTIVE;
+		uint16_t i = x - f->x1;
+		uint16_t color;
+		#ifdef ST_USE_SHADOW
+			if (f->use_shadow)
+				color = _st_shadow_get(f->disp, x, y);
+			else
 		#endif
-		ST_DC_DAT;
-		for (uint8_t pixel_cnt = 0; pixel_cnt < pixels_per_point; pixel_cnt++)
 		{
-			ST_WRITE_8BIT(color_high);
-			ST_WRITE_8BIT(color_low);
+			// Read as much of the row as fits in the (idle) pixel staging buffer
+			if (i % ST_PIXBUF_LEN == 0)
+				_st_read_pixels(f->disp, x, (f->x2 - x < ST_PIXBUF_LEN) ? f->x2 : x + ST_PIXBUF_LEN - 1, y, pixels);
+			color = pixels[i % ST_PIXBUF_LEN];
 		}
-		#ifdef ST_RELEASE_WHEN_IDLE
-			ST_CS_IDLE;
-		#endif
+		if (color == f->old_color)
+			f->match[slot][i / 8] |= 1 << (i % 8);
+		else if (color == f->new_color)
+			f->filled[slot][i / 8] |= 1 << (i % 8);
+	}
 
-		if (D > 0)
-		{
-			y = y + yi;
-			D = D - 2*dx;
-		}
-		D = D + 2*dy;
-		x++;
+	// Pixels with the fill color are all filled ones in a clean row
+	uint16_t j = y - f->y1;
+	if (!(f->seen[j / 8] & (1 << (j % 8))))
+	{
+		uint8_t clean = 1;
+		for (uint8_t i = 0; i < ST_FLOOD_ROW_BYTES; i++)
+			if (f->filled[slot][i])
+				clean = 0;
+		f->seen[j / 8] |= 1 << (j % 8);
+		f->clean[j / 8] |= clean << (j % 8);
 	}
+	return slot;
 }
 
-
 /*
- * Called by st_draw_line().
- * User need not call it
+ * Is pixel x of a cached row in the region and not filled yet?
  */
-void _st_plot_line_high(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color)
+static uint8_t _st_flood_test(const st_flood_t *f, uint8_t slot, int16_t x)
 {
-	int16_t dx = x1 - x0;
-	int16_t dy = y1 - y0;
-	int8_t xi = 1;
-	uint8_t pixels_per_point = width * width;	//no of pixels making a point. if line width is 1, this var is 1. if 2, this var is 4 and so on
-	uint8_t color_high = (uint8_t)(color >> 8);
-	uint8_t color_low = (uint8_t)color;
+	uint16_t i = x - f->x1;
+	return (f->match[slot][i / 8] >> (i % 8)) & 1;
+}
 
-	if (dx < 0)
-	{
-		xi = -1;
-		dx = -dx;
-	}
+static uint8_t _st_flood_is_filled(const st_flood_t *f, uint8_t slot, int16_t x)
+{
+	uint16_t i = x - f->x1;
+	return (f->filled[slot][i / 8] >> (i % 8)) & 1;
+}
 
-	int16_t D = 2*dx - dy;
-	uint16_t y = y0;
-	uint16_t x = x0;
+static uint8_t _st_flood_is_clean(const st_flood_t *f, int16_t y)
+{
+	uint16_t j = y - f->y1;
+	return (f->clean[j / 8] >> (j % 8)) & 1;
+}
 
-	while (y <= y1)
+/*
+ * Fill pixels x1 - x2 of row y, a cached row
+ */
+static void _st_flood_span(st_flood_t *f, uint8_t slot, int16_t x1, int16_t x2, int16_t y)
+{
+	for (uint16_t i = x1 - f->x1; i <= x2 - f->x1; i++)
 	{
-		st_set_address_window(x, y, x+width-1, y+width-1);
-		//Drawing all the pixels of a single point
-
-		#ifdef ST_RELEASE_WHEN_IDLE
-			ST_CS_ACTIVE;
-		#endif
-		ST_DC_DAT;
-		for (uint8_t pixel_cnt = 0; pixel_cnt < pixels_per_point; pixel_cnt++)
-		{
-			ST_WRITE_8BIT(color_high);
-			ST_WRITE_8BIT(color_low);
-		}
-		#ifdef ST_RELEASE_WHEN_IDLE
-			ST_CS_IDLE;
-		#endif
+		f->match[slot][i / 8] &= ~(1 << (i % 8));
+		f->filled[slot][i / 8] |= 1 << (i % 8);
+	}
 
-		if (D > 0)
-		{
-			x = x + xi;
-			D = D - 2*dy;
-		}
-		D = D + 2*dx;
-		y++;
+	// Grow the waiting rectangle by a row if the span lines up with it
+	if (f->rect && x1 == f->rect_x1 && x2 == f->rect_x2 && (y == f->rect_y2 + 1 || y == f->rect_y1 - 1))
+	{
+		if (y > f->rect_y2)
+			f->rect_y2 = y;
+		else
+			f->rect_y1 = y;
+		return;
 	}
+	_st_flood_send(f);
+	f->rect_x1 = x1;
+	f->rect_x2 = x2;
+	f->rect_y1 = f->rect_y2 = y;
+	f->rect = 1;
 }
 
-
-/**
- * Draw a line from (x0,y0) to (x1,y1) with `width` and `color`.
- * @param x0 start column address.
- * @param y0 start row address.
- * @param x1 end column address.
- * @param y1 end row address.
- * @param width width or thickness of the line
- * @param color 16-bit RGB565 color of the line
+/*
+ * Queue row y + dy to be scanned under the span x1 - x2 of row y
  */
-void st_draw_line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color)
+static void _st_flood_push(st_flood_t *f, int16_t y, int16_t x1, int16_t x2, int8_t dy)
 {
-	/*
-	* Brehensen's algorithm is used.
-	* Not necessarily start points has to be less than end points.
-	*/
+	if (y + dy < f->y1 || y + dy > f->y2)
+		return;
 
-	if (x0 == x1)	//vertical line
+	// Nothing to find if the row is cached and has no part of the region there
+	uint8_t slot = (uint16_t)(y + dy) % ST_FLOOD_ROWS;
+	if (f->row_y[slot] == y + dy)
 	{
-		_st_draw_fast_v_line(x0, y0, y1, width, color);
+		int16_t x = x1;
+		while (x <= x2 && !_st_flood_test(f, slot, x))
+			x++;
+		if (x > x2)
+			return;
 	}
-	else if (y0 == y1)		//horizontal line
+
+	if (f->sp == ST_FLOOD_STACK)
 	{
-		_st_draw_fast_h_line(x0, y0, x1, width, color);
+		int16_t y1 = (dy < 0) ? y + dy : y;
+		if (!f->overflow)
+		{
+			f->lost_x1 = x1;
+			f->lost_x2 = x2;
+			f->lost_y1 = y1;
+			f->lost_y2 = y1 + 1;
+			f->overflow = 1;
+		}
+		if (x1 < f->lost_x1)
+			f->lost_x1 = x1;
+		if (x2 > f->lost_x2)
+			f->lost_x2 = x2;
+		if (y1 < f->lost_y1)
+			f->lost_y1 = y1;
+		if (y1 + 1 > f->lost_y2)
+			f->lost_y2 = y1 + 1;
+		return;
 	}
+	f->stack[f->sp++] = (st_flood_span_t){y, x1, x2, dy};
+}
 
-	else
+/*
+ * Fill the region from every span on the stack
+ */
+static void _st_flood_run(st_flood_t *f)
+{
+	while (f->sp)
 	{
-		if (abs(y1 - y0) < abs(x1 - x0))
+		st_flood_span_t s = f->stack[--f->sp];
+		int16_t y = s.y + s.dy;
+		uint8_t row = _st_flood_row(f, y);
+		int16_t x = s.x1;
+		int16_t start;
+
+		if (_st_flood_test(f, row, x))
 		{
-			if (x0 > x1)
-				_st_plot_line_low(x1, y1, x0, y0, width, color);
-			else
-				_st_plot_line_low(x0, y0, x1, y1, width, color);
+			// The region goes on to the left of the span above
+			while (x > f->x1 && _st_flood_test(f, row, x - 1))
+				x--;
+			start = x;
+			if (start < s.x1)
+				_st_flood_push(f, y, start, s.x1 - 1, -s.dy);
+			x = s.x1;
 		}
-
 		else
 		{
-			if (y0 > y1)
-				_st_plot_line_high(x1, y1, x0, y0, width, color);
-			else
-				_st_plot_line_high(x0, y0, x1, y1, width, color) ;
+			while (x <= s.x2 && !_st_flood_test(f, row, x))
+				x++;
+			start = x;
 		}
-	}
-
-}
 
+		while (x <= s.x2)
+		{
+			while (x <= f->x2 && _st_flood_test(f, row, x))
+				x++;
+			_st_flood_span(f, row, start, x - 1, y);
+			_st_flood_push(f, y, start, x - 1, s.dy);
+			// ... and to the right of it
+			if (x - 1 > s.x2)
+				_st_flood_push(f, y, s.x2 + 1, x - 1, -s.dy);
 
-/*
- * Called by st_draw_line().
- * User need not call it
- */
-void _st_draw_fast_h_line(uint16_t x0, uint16_t y0, uint16_t x1, uint8_t width, uint16_t color)
-{
-	/*
-	* Draw a horizontal line very fast
-	*/
-	if (x0 < x1)
-		st_set_address_window(x0, y0, x1, y0+width-1);	//as it's horizontal line, y1=y0.. must be.
-	else
-		st_set_address_window(x1, y0, x0, y0+width-1);	
-	st_fill_color(color, (uint32_t)width * (uint32_t)abs(x1 - x0 + 1));
+			// Next part of the region under the span above
+			while (x <= s.x2 && !_st_flood_test(f, row, x))
+				x++;
+			start = x;
+		}
+	}
 }
 
-
 /*
- * Called by st_draw_line().
- * User need not call it
+ * Spans that didn't fit in the stack are found again: inside their bounds, a part of the region
+ * right above or below something filled becomes a new seed. Repeated until nothing is lost.
+ * Only clean rows are trusted, elsewhere a pixel with the fill color may not be a filled one.
  */
-void _st_draw_fast_v_line(uint16_t x0, uint16_t y0, uint16_t y1, uint8_t width, uint16_t color)
+static void _st_flood_rescan(st_flood_t *f)
 {
-	/*
-	* Draw a vertical line very fast
-	*/
-	if (y0 < y1)
-		st_set_address_window(x0, y0, x0+width-1, y1);	//as it's vertical line, x1=x0.. must be.
-	else
-		st_set_address_window(x0, y1, x0+width-1, y0);	
-	st_fill_color(color, (uint32_t)width * (uint32_t)abs(y1 - y0 + 1));
-}
+	while (f->overflow)
+	{
+		int16_t x1 = f->lost_x1, y1 = f->lost_y1, x2 = f->lost_x2, y2 = f->lost_y2;
+		f->overflow = 0;
+		for (int16_t y = y1; y <= y2; y++)
+		{
+			for (int16_t x = x1; x <= x2; x++)
+			{
+				uint8_t above = (y > y1 && _st_flood_is_clean(f, y - 1)) ? _st_flood_row(f, y - 1) : ST_FLOOD_ROWS;
+				uint8_t below = (y < y2 && _st_flood_is_clean(f, y + 1)) ? _st_flood_row(f, y + 1) : ST_FLOOD_ROWS;
+				uint8_t row = _st_flood_row(f, y);
+				if (!_st_flood_test(f, row, x))
+					continue;
 
+				if ((above < ST_FLOOD_ROWS && _st_flood_is_filled(f, above, x)) ||
+					(below < ST_FLOOD_ROWS && _st_flood_is_filled(f, below, x)))
+				{
+					_st_flood_push(f, y, x, x, 1);
+					_st_flood_push(f, y + 1, x, x, -1);
+					_st_flood_run(f);
+				}
+			}
+		}
+	}
+}
 
 /**
- * Draw a pixel at a given position with `color`
- * @param x Start col address
- * @param y Start row address
+ * Fill the region around (x,y) with `color`: every pixel that can be reached from (x,y) through
+ * pixels of the same color, going up, down, left or right, inside the clip rectangle.
+ * Pixels are read from the shadow if there is one (see st_set_shadow()), where all colors it
+ * doesn't know count as one. Else they're read back from the panel over SDA, so the panel's SDA
+ * must be readable (3-wire SPI) and the display needs a CS pin (`cs`), as only CS high ends a
+ * read. Filled spans are sent as single fills.
+ * Regions more complex than ST_FLOOD_STACK allows are finished by rescanning where spans were
+ * dropped. Parts of them only reachable past rows that already had `color` may be left out.
+ * @param disp display
+ * @param x column of a pixel in the region
+ * @param y row of a pixel in the region
+ * @param color 16-bit RGB565 color
+ * @return 0 if nothing is filled because neither `color` nor the region's color is known to the
+ * shadow, or because there is no shadow and no CS pin, else 1
  */
-void st_draw_pixel(uint16_t x, uint16_t y, uint16_t color)
+uint8_t st_flood_fill(st_display_t *disp, int16_t x, int16_t y, uint16_t color)
 {
-	/*
-	* Why?: This function is mainly added in the driver so that  ui libraries can use it.
-	* example: LittlevGL requires user to supply a function that can draw pixel
-	*/
+	st_flood_t f;
+	f.disp = disp;
+	f.x1 = disp->clip_x1;
+	f.y1 = disp->clip_y1;
+	f.x2 = disp->clip_x2;
+	f.y2 = disp->clip_y2;
+	if (f.x2 - f.x1 >= ST_FLOOD_ROW_BYTES * 8)
+		f.x2 = f.x1 + ST_FLOOD_ROW_BYTES * 8 - 1;
+	if (f.y2 - f.y1 >= ST_FLOOD_ROW_BYTES * 8)
+		f.y2 = f.y1 + ST_FLOOD_ROW_BYTES * 8 - 1;
+	x += disp->origin_x;
+	y += disp->origin_y;
+	if (x < f.x1 || x > f.x2 || y < f.y1 || y > f.y2)
+		return 1;
 
-	st_set_address_window(x, y, x, y);
-	#ifdef ST_RELEASE_WHEN_IDLE
-		ST_CS_ACTIVE;
+	// Without a shadow the panel is read, and only CS high ends reading
+	f.use_shadow = 0;
+	#ifdef ST_USE_SHADOW
+		f.use_shadow = disp->shadow != NULL;
 	#endif
-	ST_DC_DAT;
-	ST_WRITE_8BIT((uint8_t)(color >> 8));
-	ST_WRITE_8BIT((uint8_t)color);
-	#ifdef ST_RELEASE_WHEN_IDLE
-		ST_CS_IDLE;
+	if (!f.use_shadow && disp->cs == 0)
+		return 0;
+
+	// Recorded drawing must be on the panel before reading it, and spans are sent right away
+	#ifdef ST_USE_DISPLAY_LIST
+		uint8_t recording = disp->dlist_recording;
+		if (recording)
+			_st_dlist_send(disp);
+		disp->dlist_recording = 0;
+	#endif
+
+	f.color = color;
+	#ifdef ST_USE_SHADOW
+		if (f.use_shadow)
+		{
+			f.old_color = _st_shadow_get(disp, x, y);
+			f.new_color = _st_shadow_key(disp, color);
+		}
+		else
+	#endif
+	{
+		_st_read_pixels(disp, x, x, y, &f.old_color);
+		f.new_color = color;
+	}
+
+	uint8_t done = 1;
+	if (f.old_color == f.new_color)
+	{
+		// Nothing to do if it's the same color. The shadow can't tell apart two other colors.
+		done = !f.use_shadow || f.new_color != 0;
+	}
+	else
+	{
+		for (uint8_t i = 0; i < ST_FLOOD_ROWS; i++)
+			f.row_y[i] = -1;
+		for (uint8_t i = 0; i < ST_FLOOD_ROW_BYTES; i++)
+			f.seen[i] = f.clean[i] = 0;
+		f.sp = 0;
+		f.overflow = 0;
+		f.rect = 0;
+		_st_flood_push(&f, y, x, x, 1);
+		_st_flood_push(&f, y + 1, x, x, -1);
+		_st_flood_run(&f);
+		_st_flood_rescan(&f);
+		_st_flood_send(&f);
+	}
+
+	#ifdef ST_USE_DISPLAY_LIST
+		disp->dlist_recording = recording;
 	#endif
+	return done;
 }
 
 
 
 /**
  * Rotate the display clockwise or anti-clockwie set by `rotation`
+ * @param disp display
  * @param rotation Type of rotation. Supported values 0, 1, 2, 3
  */
-void st_rotate_display(uint8_t rotation)
+void st_rotate_display(st_display_t *disp, uint8_t rotation)
 {
 	/*
 	* 	(uint8_t)rotation :	Rotation Type
@@ -685,89 +4980,140 @@ void st_rotate_display(uint8_t rotation)
 	*/
 	// Set max rotation value to 4
 	rotation = rotation % 4;
-	_st_write_command_8bit(ST7789_MADCTL);		//Memory Access Control
+	uint8_t madctl = ST7789_MADCTL_RGB;	// Default
 	switch (rotation)
-	{		
-		case 0:
-			
-			_st_write_data_8bit(ST7789_MADCTL_RGB);	// Default
-			st_tftheight = 240;
-			st_tftwidth = 240;
-			break;
+	{
 		case 1:
-			_st_write_data_8bit(ST7789_MADCTL_MX | ST7789_MADCTL_MY | ST7789_MADCTL_RGB);
-			st_tftheight = 240;
-			st_tftwidth = 240;
+			madctl = ST7789_MADCTL_MX | ST7789_MADCTL_MY | ST7789_MADCTL_RGB;
 			break;
 		case 2:
-			_st_write_data_8bit(ST7789_MADCTL_MY | ST7789_MADCTL_MV | ST7789_MADCTL_RGB);
-			st_tftheight = 240;
-			st_tftwidth = 240;
+			madctl = ST7789_MADCTL_MY | ST7789_MADCTL_MV | ST7789_MADCTL_RGB;
 			break;
 		case 3:
-			_st_write_data_8bit(ST7789_MADCTL_MX | ST7789_MADCTL_MV | ST7789_MADCTL_RGB);
-			st_tftheight = 240;
-			st_tftwidth = 240;
+			madctl = ST7789_MADCTL_MX | ST7789_MADCTL_MV | ST7789_MADCTL_RGB;
 			break;
 	}
+	st_queue_command(disp, ST7789_MADCTL, &madctl, 1);	//Memory Access Control
+
+	// Rotations 2 and 3 exchange rows and columns (MV)
+	if ((rotation >= 2) != (disp->rotation >= 2))
+		ST_SWAP(disp->width, disp->height);
+	disp->rotation = rotation;
+	st_reset_clip(disp);
+}
+
+
+/*
+ * Clock of a GPIO port, SPI or DMA peripheral
+ */
+static enum rcc_periph_clken _st_periph_clock(uint32_t periph)
+{
+	switch (periph)
+	{
+		case GPIOB:	return RCC_GPIOB;
+		case GPIOC:	return RCC_GPIOC;
+		case GPIOD:	return RCC_GPIOD;
+		case SPI2:	return RCC_SPI2;
+		case SPI3:	return RCC_SPI3;
+		case DMA2:	return RCC_DMA2;
+		case SPI1:	return RCC_SPI1;
+		case DMA1:	return RCC_DMA1;
+		default:	return RCC_GPIOA;
+	}
 }
 
 
 /**
  * Initialize the display driver
+ * @param disp display with bus and pins set (see ST_DISPLAY_SPI1 and ST_DISPLAY_SPI2)
  */
-void st_init()
+void st_init(st_display_t *disp)
 {
+	// Driver state
+	disp->queue_head = 0;
+	disp->queue_tail = 0;
+	disp->queue_active = 0;
+	disp->spi_16bit = 0;
+	disp->dc_data = 1;		// D/C is set high below
+	disp->win_valid = 0;
+	disp->win_ramwr_open = 0;
+	disp->rotation = 0;
+	disp->madctl = 0;
+	disp->pixbuf_used = 0;
+	disp->pixbuf_half = 0;
+	disp->pixbuf_busy[0] = 0;
+	disp->pixbuf_busy[1] = 0;
+	st_reset_clip(disp);
+	#ifdef ST_USE_DISPLAY_LIST
+		disp->dlist_len = 0;
+		disp->dlist_recording = 0;
+	#endif
+	#ifdef ST_USE_SHADOW
+		disp->shadow = NULL;
+	#endif
+	#ifdef ST_USE_GLYPH_CACHE
+		disp->gcache = NULL;
+		disp->gcache_len = 0;
+	#endif
+
 	// Set gpio clock
-	ST_CONFIG_GPIO_CLOCK();
+	rcc_periph_clock_enable(_st_periph_clock(disp->spi_port));
+	rcc_periph_clock_enable(_st_periph_clock(disp->port));
+	rcc_periph_clock_enable(RCC_AFIO);
+	rcc_periph_clock_enable(_st_periph_clock(disp->spi));
 	// Configure gpio output dir and mode
-	ST_CONFIG_GPIO();
+	ST_CONFIG_GPIO(disp);
 	// If using DMA, config SPI DMA
 	#ifdef ST_USE_SPI_DMA
-		ST_CONFIG_SPI_DMA();
+		rcc_periph_clock_enable(_st_periph_clock(disp->dma));
+		ST_CONFIG_SPI_DMA(disp);
 	#endif
 	// Configure SPI settings
-	ST_CONFIG_SPI();
+	ST_CONFIG_SPI(disp);
 
-	#ifdef ST_HAS_CS
-		ST_CS_ACTIVE;
-	#endif
+	if (disp->cs)
+		ST_CS_ACTIVE(disp);
 
 	// Hardwae reset is not mandatory if software rest is done
-	#ifdef ST_HAS_RST
-		ST_RST_ACTIVE;
-		_st_fixed_delay();
-		ST_RST_IDLE;
-		_st_fixed_delay();
-	#endif
+	if (disp->rst)
+	{
+		ST_RST_ACTIVE(disp);
+		_st_delay_ms(disp, 1);		// reset pulse: 10 us min
+		ST_RST_IDLE(disp);
+		_st_delay_ms(disp, 120);	// reset done
+	}
 
-	_st_write_command_8bit(ST7789_SWRESET);	//1: Software reset, no args, w/delay: delay(150)
-	_st_fixed_delay();
+	// Delays are the datasheet's, counted once the command is sent
+	_st_write_command_8bit(disp, ST7789_SWRESET);	//1: Software reset, no args
+	_st_delay_ms(disp, 120);						// 5 ms, 120 ms before SLPOUT
 
-	_st_write_command_8bit(ST7789_SLPOUT);	// 2: Out of sleep mode, no args, w/delay: delay(500)
-	_st_fixed_delay();
+	_st_write_command_8bit(disp, ST7789_SLPOUT);	// 2: Out of sleep mode, no args
+	_st_delay_ms(disp, 120);						// supply and clocks settle
 
-	_st_write_command_8bit(ST7789_COLMOD);	// 3: Set color mode, 1 arg, delay: delay(10)
-	_st_write_data_8bit(ST7789_COLOR_MODE_65K | ST7789_COLOR_MODE_16BIT);	// 65K color, 16-bit color
-	_st_fixed_delay();
+	_st_write_command_8bit(disp, ST7789_COLMOD);	// 3: Set color mode, 1 arg
+	_st_write_data_8bit(disp, ST7789_COLOR_MODE_65K | ST7789_COLOR_MODE_16BIT);	// 65K color, 16-bit color
 
-	_st_write_command_8bit(ST7789_MADCTL);	// 4: Memory access ctrl (directions), 1 arg:
-	_st_write_data_8bit(ST7789_MADCTL_RGB);	// RGB Color
+	uint8_t madctl = ST7789_MADCTL_RGB;				// RGB Color
+	st_queue_command(disp, ST7789_MADCTL, &madctl, 1);	// 4: Memory access ctrl (directions), 1 arg:
 
-	_st_write_command_8bit(ST7789_INVON);	// 5: Inversion ON (but why?) delay(10)
-	_st_fixed_delay();
+	_st_write_command_8bit(disp, ST7789_INVON);	// 5: Inversion ON (but why?)
 
-	_st_write_command_8bit(ST7789_NORON);	// 6: Normal display on, no args, w/delay: delay(10)
-	_st_fixed_delay();
+	_st_write_command_8bit(disp, ST7789_NORON);	// 6: Normal display on, no args
+	_st_delay_ms(disp, 10);
 
-	_st_write_command_8bit(ST7789_DISPON);	// 7: Main screen turn on, no args, w/delay: delay(500)
-	_st_fixed_delay();
+	_st_write_command_8bit(disp, ST7789_DISPON);	// 7: Main screen turn on, no args
+	_st_delay_ms(disp, 10);
 }
 
 
-void _st_fixed_delay()
+/**
+ * Wait until all queued jobs are sent, then `ms` milliseconds more.
+ * Time is counted with the DWT cycle counter at `rcc_ahb_frequency`, so set the clock up before st_init().
+ * Used for sending start sequence
+ */
+void _st_delay_ms(st_display_t *disp, uint16_t ms)
 {
-	for (uint16_t i = 0; i < 5000; i++)
-		__asm__("nop");
+	st_wait_idle(disp);
+	_st_delay_cycles((rcc_ahb_frequency / 1000) * ms);
 }
 
@@ -28,6 +28,7 @@ SOFTWARE.
 #include <libopencm3/stm32/spi.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
 #include <stdlib.h>
 
 #ifndef INC_ST7789_STM32_SPI_H_
@@ -114,213 +115,491 @@ SOFTWARE.
 #define ST_COLOR_GREENYELLOW ST_RGB(173, 255,  41)
 #define ST_COLOR_PINK        ST_RGB(255, 130, 198)
 
+// Gradient types (see st_fill_gradient_rect())
+#define ST_GRADIENT_VERTICAL	0
+#define ST_GRADIENT_HORIZONTAL	1
+#define ST_GRADIENT_RADIAL		2
+#define ST_GRADIENT_DITHER		0x80	// add to a type to dither the steps between RGB565 colors
+
+// Corners of thick polylines and paths (see st_draw_polyline())
+#define ST_JOIN_MITER	0
+#define ST_JOIN_BEVEL	1
+#define ST_JOIN_ROUND	2
+
 
 /**
- * Pin mapping:
+ * Default pin mapping of a display on SPI1 (ST_DISPLAY_SPI1):
  * ST7789				STM32
  * ---------------------------
  * SDA					PA7
- * SCL					PA5				..			
+ * SCL					PA5
  * RESETn				PA4
  * D/Cn					PA2
  * BLK					PA3
+ *
+ * Default pin mapping of a display on SPI2 (ST_DISPLAY_SPI2):
+ * ST7789				STM32
+ * ---------------------------
+ * SDA					PB15
+ * SCL					PB13
+ * RESETn				PB14
+ * D/Cn					PB12
+ * BLK					PB11
  */
 
 #define ST_USE_SPI_DMA
-#define ST_HAS_RST
-//#define ST_HAS_CS
-#ifdef ST_HAS_CS
-//	#define ST_RELEASE_WHEN_IDLE
-#endif
+//#define ST_RELEASE_WHEN_IDLE		// Release CS while the driver is idle (needs `cs` pin)
 
-#define ST_SPI			SPI1
 #ifdef ST_USE_SPI_DMA
-	#define ST_DMA			DMA1
-	#define ST_DMA_CHANNEL	3
+	// Data and fill transfers shorter than this (in bytes) are written by the CPU.
+	// Starting a DMA transfer and taking its interrupt costs more than a few SPI bytes.
+	#define ST_DMA_MIN_BYTES	32
 #endif
 
-#define ST_PORT			GPIOA
-
-#define ST_RST			GPIO4
-#define ST_DC			GPIO2
-#define ST_SDA			GPIO7
-#define ST_SCL			GPIO5
-#define ST_BLK			GPIO3
-// To use Chip Select (CS), uncomment `HAS_CS` above
-#define ST_CS			GPIO6
-
+// Max number of transfer jobs waiting to be sent. Drawing functions block only when it's full.
+#define ST_QUEUE_LEN	16
+
+// Pixels generated by the driver (anti-aliased edges, ...) are staged here until they're sent.
+// Two halves are used in turn, so one can be filled while the other is being sent.
+#define ST_PIXBUF_LEN	512
+
+// Max depth of the clip rectangle stack (see st_push_clip()), 12 bytes per level
+#define ST_CLIP_DEPTH	4
+
+// Pixels of st_draw_pixels() are sorted in batches of this many (max 256, 4 bytes each on the stack)
+#define ST_PIXELS_BATCH	128
+
+// Max number of polygon edges crossing one row (12 bytes each, on the stack of st_fill_polygon()).
+// Rows crossing more edges are filled by a slower method.
+#define ST_POLY_MAX_EDGES	32
+
+// Curves of st_draw_bezier2() and st_draw_bezier3() are drawn as lines at most this far from
+// the curve, in 1/16 px. Flat parts of a curve take fewer lines.
+#define ST_BEZIER_TOLERANCE	4
+// Max number of times a curve is halved. It's drawn with at most 2^depth lines.
+// Each level takes 33 bytes on the stack, and each line 4 more.
+#define ST_BEZIER_DEPTH		6
+
+// Max number of spans waiting to be scanned by st_flood_fill(). It takes about 370 bytes of
+// stack plus 8 per span. Regions needing more are finished by rescanning, which is slower.
+#define ST_FLOOD_STACK		32
+
+// SPI clock while pixels are read back from the panel (st_flood_fill()). The controller
+// is read at up to ~6.6 MHz, much slower than it's written.
+#define ST_READ_BAUDRATE	SPI_CR1_BAUDRATE_FPCLK_DIV_16
+
+// Shadow buffer: remember which of a few colors every pixel has, so st_flood_fill() can work
+// without reading the panel (see st_set_shadow()). Comment out to save the code.
+#define ST_USE_SHADOW
+
+// Glyph cache: keep glyphs of text with background expanded to RGB565 in a buffer given to
+// st_set_glyph_cache(), so drawing them again in the same colors is a single DMA transfer.
+// Comment out to save the RAM of the entries.
+#define ST_USE_GLYPH_CACHE
+#ifdef ST_USE_GLYPH_CACHE
+	// Max number of cached glyphs (16 bytes each). The least recently drawn one is evicted.
+	#define ST_GLYPH_CACHE_ENTRIES	32
+#endif
 
-#define ST_DC_CMD			GPIO_BRR(ST_PORT) = ST_DC
-#define ST_DC_DAT			GPIO_BSRR(ST_PORT) = ST_DC
-#define ST_RST_ACTIVE		GPIO_BRR(ST_PORT) = ST_RST
-#define ST_RST_IDLE			GPIO_BSRR(ST_PORT) = ST_RST
-#ifdef ST_HAS_CS
-	#define ST_CS_ACTIVE		GPIO_BRR(ST_PORT) = ST_CS
-	#define ST_CS_IDLE			GPIO_BSRR(ST_PORT) = ST_CS
+// Display list: record drawing calls between st_begin_list() and st_flush(), and send them
+// with overdraw removed. Comment out to save the RAM of the list.
+#define ST_USE_DISPLAY_LIST
+#ifdef ST_USE_DISPLAY_LIST
+	// Max number of recorded rectangles (16 bytes each). The list is sent early when it's full.
+	#define ST_DLIST_LEN		64
+	// A recorded fill is cut around a later rectangle hiding part of it only if at least
+	// this many pixels are saved. Each extra piece costs a window setup (~15 bytes).
+	#define ST_DLIST_MIN_CUT	64
 #endif
 
-#define ST_CONFIG_GPIO_CLOCK()	{ \
-									rcc_periph_clock_enable(RCC_GPIOA); \
-									rcc_periph_clock_enable(RCC_AFIO); \
-									rcc_periph_clock_enable(RCC_SPI1); \
-									rcc_periph_clock_enable(RCC_DMA1); \
+/*
+ * Initializers for `st_display_t`. Fields can be changed before calling st_init().
+ * SPI1 uses DMA1 channel 3, SPI2 uses DMA1 channel 5. The DMA channel is fixed by the hardware.
+ * Unused control pins (rst, cs, blk) are set to 0.
+ */
+#define ST_DISPLAY_SPI1		{ \
+								.spi = SPI1, .dma = DMA1, .dma_channel = 3, .dma_irq = NVIC_DMA1_CHANNEL3_IRQ, \
+								.spi_port = GPIOA, .scl = GPIO5, .sda = GPIO7, \
+								.port = GPIOA, .rst = GPIO4, .dc = GPIO2, .blk = GPIO3, .cs = 0, \
+								.width = 240, .height = 240, \
+							}
+
+#define ST_DISPLAY_SPI2		{ \
+								.spi = SPI2, .dma = DMA1, .dma_channel = 5, .dma_irq = NVIC_DMA1_CHANNEL5_IRQ, \
+								.spi_port = GPIOB, .scl = GPIO13, .sda = GPIO15, \
+								.port = GPIOB, .rst = GPIO14, .dc = GPIO12, .blk = GPIO11, .cs = 0, \
+								.width = 240, .height = 240, \
+							}
+
+
+#define ST_DC_CMD(disp)			GPIO_BRR((disp)->port) = (disp)->dc
+#define ST_DC_DAT(disp)			GPIO_BSRR((disp)->port) = (disp)->dc
+#define ST_RST_ACTIVE(disp)		GPIO_BRR((disp)->port) = (disp)->rst
+#define ST_RST_IDLE(disp)		GPIO_BSRR((disp)->port) = (disp)->rst
+#define ST_CS_ACTIVE(disp)		GPIO_BRR((disp)->port) = (disp)->cs
+#define ST_CS_IDLE(disp)		GPIO_BSRR((disp)->port) = (disp)->cs
+
+#define ST_CONFIG_GPIO(disp)	{ \
+									/*Configure SPI pins, SCL and SDA */ \
+									gpio_set_mode((disp)->spi_port, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, (disp)->scl|(disp)->sda); \
+									/*Configure control pins, unused ones are 0 */ \
+									gpio_set_mode((disp)->port, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, (disp)->dc|(disp)->blk|(disp)->rst|(disp)->cs); \
+									/*Configure GPIO pin Output Level */ \
+									gpio_set((disp)->port, (disp)->blk|(disp)->rst|(disp)->dc|(disp)->cs); \
+									/* Configures PB4 as GPIO */ \
+									AFIO_MAPR |= AFIO_MAPR_SWJ_CFG_FULL_SWJ_NO_JNTRST; \
 								}
-#ifdef ST_HAS_CS
-	#define ST_CONFIG_GPIO()		{ \
-										/*Configure GPIO pins : PA2 PA3 PA4 PA5 PA7 */ \
-										gpio_set_mode(ST_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, ST_SCL|ST_SDA); \
-										gpio_set_mode(ST_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, ST_DC|ST_BLK|ST_RST|ST_CS); \
-										/*Configure GPIO pin Output Level */ \
-										gpio_set(ST_PORT, ST_BLK|ST_RST|ST_DC|ST_CS); \
-										/* Configures PB4 as GPIO */ \
-										AFIO_MAPR |= AFIO_MAPR_SWJ_CFG_FULL_SWJ_NO_JNTRST; \
-									}
-#else
-	#define ST_CONFIG_GPIO()		{ \
-										/*Configure GPIO pins : PA2 PA3 PA4 PA5 PA7 */ \
-										gpio_set_mode(ST_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, ST_SCL|ST_SDA); \
-										gpio_set_mode(ST_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, ST_DC|ST_BLK|ST_RST); \
-										/*Configure GPIO pin Output Level */ \
-										gpio_set(ST_PORT, ST_BLK|ST_RST|ST_DC); \
-										/* Configures PB4 as GPIO */ \
-										AFIO_MAPR |= AFIO_MAPR_SWJ_CFG_FULL_SWJ_NO_JNTRST; \
-									}
-#endif
 
-#define ST_CONFIG_SPI()			{ \
+#define ST_CONFIG_SPI(disp)		{ \
 									/* Reset SPI, SPI_CR1 register cleared, SPI is disabled */ \
-									spi_reset(ST_SPI); \
-									SPI_I2SCFGR(ST_SPI) = 0; \
+									spi_reset((disp)->spi); \
+									SPI_I2SCFGR((disp)->spi) = 0; \
 									/* Must use SPI_MODE = 2. (CPOL 1, CPHA 0) */\
 									/* Read about SPI MODEs: https://en.wikipedia.org/wiki/Serial_Peripheral_Interface*/ \
-									spi_init_master(ST_SPI, SPI_CR1_BAUDRATE_FPCLK_DIV_2, SPI_CR1_CPOL_CLK_TO_1_WHEN_IDLE, SPI_CR1_CPHA_CLK_TRANSITION_1, SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST); \
-									spi_enable_software_slave_management(ST_SPI); \
-									spi_set_full_duplex_mode(ST_SPI); \
-									spi_set_nss_high(ST_SPI); \
-									/* Enable SPI1 periph. */ \
-									spi_enable(ST_SPI); \
+									spi_init_master((disp)->spi, SPI_CR1_BAUDRATE_FPCLK_DIV_2, SPI_CR1_CPOL_CLK_TO_1_WHEN_IDLE, SPI_CR1_CPHA_CLK_TRANSITION_1, SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST); \
+									spi_enable_software_slave_management((disp)->spi); \
+									/* Bidirectional (3-wire) mode on SDA. Transmit-only mode never fills the rx buffer, */ \
+									/* it's only turned around to read pixels back (st_flood_fill()). */ \
+									spi_set_bidirectional_transmit_only_mode((disp)->spi); \
+									spi_set_nss_high((disp)->spi); \
+									/* Enable SPI periph. */ \
+									spi_enable((disp)->spi); \
 								}
 
 
 #define ST_SWAP(a, b)		{uint16_t temp; temp = a; a = b; b = temp;}
 
 
-// Either use TXE and BSY flag check to ensure transaction completes, 
-// or use nops to get higher fps. Add more nops if display is not working properly
-// Remove nops if fps is too low. 
-// Rule of thumb: If optimization flag value is set to higher, and/or MCU is overclocked, then increase nops
-
-// Note: If display shows wrong output, either change number of nops as said above,
-//		 or uncomment TXE and BSY flag checks and comment out all nops.
-#define ST_WRITE_8BIT(d)	do{ \
-							SPI_DR(ST_SPI) = (uint8_t)(d); \
-							/*while (!(SPI_SR(ST_SPI) & SPI_SR_TXE));*/ \
-							/*while (SPI_SR(ST_SPI) & SPI_SR_BSY);*/ \
-							__asm__("nop"); __asm__("nop"); __asm__("nop"); __asm__("nop"); \
-							__asm__("nop"); __asm__("nop"); __asm__("nop"); __asm__("nop"); \
-							__asm__("nop"); __asm__("nop"); __asm__("nop"); __asm__("nop"); \
-							__asm__("nop"); __asm__("nop"); __asm__("nop"); __asm__("nop"); \
-							__asm__("nop"); __asm__("nop"); __asm__("nop"); __asm__("nop"); \
-						} while(0)
+// Writes are paced by the SPI status flags, so they work at any optimization level and clock speed.
+// A byte is written as soon as the tx buffer is empty, while the previous one is still being
+// shifted out. So, back to back bytes leave no gap on the bus.
+#define ST_WRITE_8BIT(spi, d)	do{ \
+								while (!(SPI_SR(spi) & SPI_SR_TXE)); \
+								SPI_DR(spi) = (uint8_t)(d); \
+							} while(0)
+
+// Used for pixel data, when SPI is in 16-bit mode. Same as ST_WRITE_8BIT().
+#define ST_WRITE_16BIT(spi, d)	do{ \
+								while (!(SPI_SR(spi) & SPI_SR_TXE)); \
+								SPI_DR(spi) = (uint16_t)(d); \
+							} while(0)
+
+// Wait until the last written frame has completely left the shift register.
+// Must be done before changing D/C or CS, and before changing SPI settings.
+#define ST_WAIT_SPI_IDLE(spi)	do{ \
+								while (!(SPI_SR(spi) & SPI_SR_TXE)); \
+								while (SPI_SR(spi) & SPI_SR_BSY); \
+							} while(0)
+
+// Stops the compiler from moving memory accesses across it
+#define ST_COMPILER_BARRIER()	__asm__ __volatile__("" : : : "memory")
 
 #ifdef ST_USE_SPI_DMA
 
-	#define ST_CONFIG_SPI_DMA()		{ \
+	#define ST_CONFIG_SPI_DMA(disp)	{ \
 									/* DMA Peripheral address set to SPI*/ \
-									DMA_CPAR(ST_DMA, ST_DMA_CHANNEL) = (uint32_t)&SPI_DR(ST_SPI); \
+									DMA_CPAR((disp)->dma, (disp)->dma_channel) = (uintptr_t)&SPI_DR((disp)->spi); \
 									/* Dma memory address is reset */ \
-									DMA_CMAR(ST_DMA, ST_DMA_CHANNEL) = 0; \
+									DMA_CMAR((disp)->dma, (disp)->dma_channel) = 0; \
 									/* Number of data transfer is reset */ \
-									DMA_CNDTR(ST_DMA, ST_DMA_CHANNEL) = 0; \
+									DMA_CNDTR((disp)->dma, (disp)->dma_channel) = 0; \
 									/* DMA priority is high */ \
-									DMA_CCR(ST_DMA, ST_DMA_CHANNEL) = DMA_CCR_PL_HIGH; \
+									DMA_CCR((disp)->dma, (disp)->dma_channel) = DMA_CCR_PL_HIGH; \
 									/* Data transfer direction: Read from memory */ \
-									DMA_CCR(ST_DMA, ST_DMA_CHANNEL) |= DMA_CCR_DIR; \
+									DMA_CCR((disp)->dma, (disp)->dma_channel) |= DMA_CCR_DIR; \
 									/* Disable circular DMA */ \
-									DMA_CCR(ST_DMA, ST_DMA_CHANNEL) &= ~DMA_CCR_CIRC; \
+									DMA_CCR((disp)->dma, (disp)->dma_channel) &= ~DMA_CCR_CIRC; \
 									/* peripheral increment disabled */\
-									DMA_CCR(ST_DMA, ST_DMA_CHANNEL) &= ~DMA_CCR_PINC; \
+									DMA_CCR((disp)->dma, (disp)->dma_channel) &= ~DMA_CCR_PINC; \
 									/* memory increment enabled */ \
-									DMA_CCR(ST_DMA, ST_DMA_CHANNEL) |= DMA_CCR_MINC; \
+									DMA_CCR((disp)->dma, (disp)->dma_channel) |= DMA_CCR_MINC; \
 									/* peripheral and memory data size set to 8 bit */ \
-									DMA_CCR(ST_DMA, ST_DMA_CHANNEL) |= DMA_CCR_PSIZE_8BIT | DMA_CCR_MSIZE_8BIT; \
+									DMA_CCR((disp)->dma, (disp)->dma_channel) |= DMA_CCR_PSIZE_8BIT | DMA_CCR_MSIZE_8BIT; \
+									/* Transfer complete interrupt moves the job queue forward */ \
+									DMA_CCR((disp)->dma, (disp)->dma_channel) |= DMA_CCR_TCIE; \
+									nvic_enable_irq((disp)->dma_irq); \
 								}
 
-	
-	__attribute__((always_inline)) static inline void _st_write_spi_dma(void *data_addr, uint16_t length)
-	{
-		// Set memory source address
-		DMA_CMAR(ST_DMA, ST_DMA_CHANNEL) = (uint32_t)data_addr;
-		// set data count
-		DMA_CNDTR(ST_DMA, ST_DMA_CHANNEL) = length;
-
-		// Enable DMA channel 
-		DMA_CCR(ST_DMA, ST_DMA_CHANNEL) |= DMA_CCR_EN;
-		// Enable SPI DMA. This will start the DMA transaction
-		SPI_CR2(ST_SPI) |= SPI_CR2_TXDMAEN;
-
-		// wait until all data is sent (count becomes 0)
-		while (DMA_CNDTR(ST_DMA, ST_DMA_CHANNEL));
-		// Wait until tx buffer is empty (not set)
-		while (!(SPI_SR(ST_SPI) & SPI_SR_TXE));
-		// Wait until bus is not busy
-		while (SPI_SR(ST_SPI) & SPI_SR_BSY);
-	
-		// Disable SPI DMA tx
-		SPI_CR2(ST_SPI) &= ~SPI_CR2_TXDMAEN;
-		// Disable DMA channel
-		DMA_CCR(ST_DMA, ST_DMA_CHANNEL) &= ~DMA_CCR_EN;
-	}
+#endif
+
+/*
+ * Called when a queued callback job is reached. Runs in DMA interrupt context
+ * (or directly from the caller if DMA is disabled), so it must return quickly
+ * and must not queue new jobs.
+ */
+typedef void (*st_callback_t)(void *arg);
+
+/*
+ * Transfer job. Used by the driver only.
+ */
+typedef struct
+{
+	uint8_t type;
+	uint8_t cmd;
+	uint8_t n_bytes;
+	uint8_t bytes[4];
+	uint16_t color;
+	uint16_t period;			// REPEAT: pixels in `data`
+	const uint8_t *data;		// DATA, DATA16: next byte to send. REPEAT: the buffer. CALLBACK: user argument
+	uint32_t len;				// DATA: bytes left. FILL, DATA16, REPEAT: pixels left
+	st_callback_t callback;
+} st_job_t;
+
+/*
+ * A point on the display. Coordinates may be outside of it.
+ */
+typedef struct
+{
+	int16_t x, y;
+} st_point_t;
+
+/*
+ * Lines through points, in subpaths (see st_path_init()). Points are stored in a buffer given
+ * by the user. Each subpath is ended by a marker point with x = ST_PATH_END, and y = 1 if
+ * it's closed.
+ */
+#define ST_PATH_END		INT16_MIN
+
+typedef struct
+{
+	st_point_t *points;
+	uint16_t len;				// size of the buffer
+	uint16_t n;					// points used
+	uint16_t start;				// first point of the open subpath
+} st_path_t;
+
+/*
+ * Saved clip rectangle and origin. Used by the driver only.
+ */
+typedef struct
+{
+	int16_t x1, y1, x2, y2;
+	int16_t origin_x, origin_y;
+} st_clip_t;
 
+#ifdef ST_USE_DISPLAY_LIST
+/*
+ * Display list item. Used by the driver only.
+ */
+typedef struct
+{
+	uint16_t x, y, w, h;
+	uint16_t color;
+	uint8_t type;
+	const void *data;
+} st_dl_item_t;
 #endif
 
+#ifdef ST_USE_GLYPH_CACHE
 /*
- * inline function to send 8 bit command to the display
- * User need not call it
+ * Cached glyph. Used by the driver only.
+ */
+typedef struct
+{
+	const tImage *glyph;			// glyph of a font (font and code), NULL if the entry is free
+	uint16_t fore_color, back_color;
+	uint16_t offset;				// first pixel in the cache buffer
+	uint16_t fence;					// pixels are sent once this many fences have passed
+	uint32_t used;					// when the glyph was last drawn
+} st_glyph_entry_t;
+
+/*
+ * Glyph cache statistics (see st_get_glyph_cache_stats())
+ */
+typedef struct
+{
+	uint32_t hits;					// glyphs sent from the cache
+	uint32_t misses;				// glyphs expanded (into the cache if they fit)
+	uint32_t evictions;				// glyphs dropped to make room
+} st_glyph_cache_stats_t;
+#endif
+
+/*
+ * One display. Bus and pins are set by the user (see ST_DISPLAY_SPI1 and ST_DISPLAY_SPI2),
+ * the rest is driver state. Every display needs its own SPI and DMA channel.
  */
-__attribute__((always_inline)) static inline void _st_write_command_8bit(uint8_t cmd)
+typedef struct
 {
-	#ifdef ST_RELEASE_WHEN_IDLE
-		CS_ACTIVE;
+	// Bus
+	uint32_t spi;
+	uint32_t dma;
+	uint8_t dma_channel;
+	uint8_t dma_irq;
+	uint32_t spi_port;			// port of SCL and SDA pins
+	uint16_t scl, sda;
+	// Control pins, all on `port`. 0 if not connected (except dc)
+	uint32_t port;
+	uint16_t rst, dc, blk, cs;
+	// Current width and height. Changed by st_rotate_display()
+	uint16_t width, height;
+
+	// Driver state. Don't touch.
+	st_job_t queue[ST_QUEUE_LEN];
+	volatile uint8_t queue_head;	// job being sent
+	volatile uint8_t queue_tail;	// first free slot
+	volatile uint8_t queue_active;	// 1 while jobs are being sent
+	uint8_t spi_16bit;				// 1 if SPI is set to 16-bit data frames
+	uint8_t dc_data;				// current level of the D/C pin (1: data, 0: command)
+	uint16_t dma_chunk;				// size of the running DMA transfer
+	uint8_t rotation;				// set by st_rotate_display()
+	uint8_t madctl;					// MADCTL as it will be once all queued jobs are sent
+	// Address window cache (see st_set_address_window())
+	uint16_t win_x1, win_x2, win_y1, win_y2;
+	uint8_t win_valid;				// 0 until the controller's window is known
+	uint8_t win_ramwr_open;			// 1 if RAMWR was the last command
+	uint32_t win_written;			// bytes written since RAMWR, modulo window size
+	// Clipping (see st_push_clip()). The clip rectangle is in screen coordinates, corners inclusive.
+	int16_t origin_x, origin_y;		// screen position of drawing coordinate (0,0)
+	int16_t clip_x1, clip_y1, clip_x2, clip_y2;
+	st_clip_t clip_stack[ST_CLIP_DEPTH];
+	uint8_t clip_depth;
+	// Staging buffer of generated pixels (see _st_pixbuf_get())
+	uint16_t pixbuf[ST_PIXBUF_LEN];
+	uint16_t pixbuf_used;			// pixels taken from the current half
+	uint8_t pixbuf_half;			// half being filled
+	volatile uint8_t pixbuf_busy[2];	// 1 while queued jobs still read a half
+	#ifdef ST_USE_DISPLAY_LIST
+		st_dl_item_t dlist[ST_DLIST_LEN];
+		uint8_t dlist_len;
+		uint8_t dlist_recording;
 	#endif
-	ST_DC_CMD;
-	ST_WRITE_8BIT(cmd);
-	#ifdef ST_RELEASE_WHEN_IDLE
-		CS_IDLE;
+	#ifdef ST_USE_SHADOW
+		uint8_t *shadow;				// 1 or 2 bits per panel pixel, NULL if not used (see st_set_shadow())
+		uint8_t shadow_bpp;
+		uint16_t shadow_colors[3];		// colors with a key of their own (1 - 3), any other color is 0
+		uint8_t shadow_high;			// first byte of a pixel split across byte jobs
 	#endif
+	#ifdef ST_USE_GLYPH_CACHE
+		uint16_t *gcache;				// expanded glyphs, NULL if not used (see st_set_glyph_cache())
+		uint16_t gcache_len;			// size of `gcache` in pixels
+		st_glyph_entry_t gcache_entries[ST_GLYPH_CACHE_ENTRIES];
+		uint32_t gcache_clock;			// glyphs drawn from the cache, for LRU
+		uint16_t gcache_fences;			// fences queued after cached glyphs
+		volatile uint16_t gcache_passed;	// fences reached by the queue
+		uint8_t gcache_open;			// 1 if cached glyphs were queued after the last fence
+		st_glyph_cache_stats_t gcache_stats;
+	#endif
+} st_display_t;
+
+/**
+ * Queue a command byte followed by up to 4 parameter bytes.
+ * Parameters are copied, so the caller's buffer can be reused right away.
+ * @param disp display
+ * @param cmd command byte (sent with D/C low)
+ * @param params pointer to the parameter bytes, may be NULL if `n_params` is 0
+ * @param n_params number of parameter bytes (max 4)
+ */
+void st_queue_command(st_display_t *disp, uint8_t cmd, const uint8_t *params, uint8_t n_params);
+
+/**
+ * Queue up to 4 data bytes. Bytes are copied into the queue.
+ * @param disp display
+ * @param bytes pointer to the data bytes
+ * @param n_bytes number of bytes (max 4)
+ */
+void st_queue_bytes(st_display_t *disp, const uint8_t *bytes, uint8_t n_bytes);
+
+/**
+ * Queue a data buffer to be sent to the display.
+ * The buffer is NOT copied. It must stay valid until the transfer completes
+ * (see `st_wait_idle()` and `st_queue_callback()`).
+ * @param disp display
+ * @param data pointer to the data
+ * @param len number of bytes
+ */
+void st_queue_data(st_display_t *disp, const void *data, uint32_t len);
+
+/**
+ * Queue a buffer of RGB565 pixels to be sent to the display as 16-bit SPI frames.
+ * Pixels are native `uint16_t` values, so no byte swapping is needed.
+ * The buffer is NOT copied. It must stay valid until the transfer completes.
+ * @param disp display
+ * @param data pointer to the pixels
+ * @param len number of pixels
+ */
+void st_queue_data16(st_display_t *disp, const uint16_t *data, uint32_t len);
+
+/**
+ * Queue `len` pixels of `color`. Same as `st_fill_color()`.
+ * @param disp display
+ * @param color 16-bit RGB565 color value
+ * @param len 32-bit number of pixels
+ */
+void st_queue_fill(st_display_t *disp, uint16_t color, uint32_t len);
+
+/**
+ * Queue a callback. It is called once all jobs queued before it are sent.
+ * @param disp display
+ * @param callback function to call
+ * @param arg argument passed to `callback`
+ */
+void st_queue_callback(st_display_t *disp, st_callback_t callback, void *arg);
+
+/**
+ * Block until all queued jobs are sent and the SPI bus is idle.
+ * Call it before touching memory that was passed to `st_queue_data()` or `st_draw_bitmap()`.
+ */
+void st_wait_idle(st_display_t *disp);
+
+/**
+ * Check if there are queued jobs which are not sent yet.
+ * @return 1 if the driver is still sending, 0 if idle
+ */
+uint8_t st_is_busy(st_display_t *disp);
+
+#ifdef ST_USE_SPI_DMA
+/**
+ * DMA transfer complete interrupt handler of a display. Call it from the ISR of the display's
+ * DMA channel, e.g. `void dma1_channel3_isr(void) { st_dma_isr(&display); }`
+ * @param disp display using this DMA channel
+ */
+void st_dma_isr(st_display_t *disp);
+#endif
+
+#ifdef ST_USE_DISPLAY_LIST
+
+/**
+ * Start recording drawing calls into the display list instead of sending them.
+ * Fills, lines, rectangles, pixels, text without background and bitmaps are recorded. Anything
+ * else (text with background, st_set_address_window(), st_queue_*() etc.) sends the recorded list first.
+ */
+void st_begin_list(st_display_t *disp);
+
+/**
+ * Send the recorded display list and stop recording.
+ * Fills hidden by later drawing are dropped or cut, touching fills of the same color
+ * are merged, and the result is sent in scanline order.
+ */
+void st_flush(st_display_t *disp);
+
+#endif
+
+/*
+ * inline function to send 8 bit command to the display
+ * User need not call it
+ */
+__attribute__((always_inline)) static inline void _st_write_command_8bit(st_display_t *disp, uint8_t cmd)
+{
+	st_queue_command(disp, cmd, NULL, 0);
 }
 
 /*
  * inline function to send 8 bit data to the display
  * User need not call it
  */
-__attribute__((always_inline)) static inline void _st_write_data_8bit(uint8_t dat)
+__attribute__((always_inline)) static inline void _st_write_data_8bit(st_display_t *disp, uint8_t dat)
 {
-	#ifdef ST_RELEASE_WHEN_IDLE
-		CS_ACTIVE;
-	#endif
-	ST_DC_DAT;
-	ST_WRITE_8BIT(dat);
-	#ifdef ST_RELEASE_WHEN_IDLE
-		CS_IDLE;
-	#endif
+	st_queue_bytes(disp, &dat, 1);
 }
 
 /*
  * inline function to send 16 bit data to the display
  * User need not call it
  */
-__attribute__((always_inline)) static inline void _st_write_data_16bit(uint16_t dat)
+__attribute__((always_inline)) static inline void _st_write_data_16bit(st_display_t *disp, uint16_t dat)
 {
-	#ifdef ST_RELEASE_WHEN_IDLE
-		CS_ACTIVE;
-	#endif
-	ST_DC_DAT;
-	ST_WRITE_8BIT((uint8_t)(dat >> 8));
-	ST_WRITE_8BIT((uint8_t)dat);
-	#ifdef ST_RELEASE_WHEN_IDLE
-		CS_IDLE;
-	#endif
+	uint8_t bytes[2] = {(uint8_t)(dat >> 8), (uint8_t)dat};
+	st_queue_bytes(disp, bytes, 2);
 }
 
 /*
@@ -328,31 +607,35 @@ __attribute__((always_inline)) static inline void _st_write_data_16bit(uint16_t
 */
 
 /**
- * fixed delay of 5000 NOPs + time due to looping.
- * Used for sendinf start sequence
+ * Wait until all queued jobs are sent, then `ms` milliseconds more.
+ * Time is counted with the DWT cycle counter at `rcc_ahb_frequency`, so set the clock up before st_init().
+ * Used for sending start sequence
  */
-void _st_fixed_delay();
+void _st_delay_ms(st_display_t *disp, uint16_t ms);
 
 /**
  * Set an area for drawing on the display with start row,col and end row,col.
  * User don't need to call it usually, call it only before some functions who don't call it by default.
+ * @param disp display
  * @param x1 start column address.
  * @param y1 start row address.
  * @param x2 end column address.
  * @param y2 end row address.
  */
-void st_set_address_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+void st_set_address_window(st_display_t *disp, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
 
 /**
  * Fills `len` number of pixels with `color`.
  * Call st_set_address_window() before calling this function.
+ * @param disp display
  * @param color 16-bit RGB565 color value
  * @param len 32-bit number of pixels
  */
-void st_fill_color(uint16_t color, uint32_t len);
+void st_fill_color(st_display_t *disp, uint16_t color, uint32_t len);
 
 /**
  * Draw a line from (x0,y0) to (x1,y1) with `width` and `color`.
+ * @param disp display
  * @param x0 start column address.
  * @param y0 start row address.
  * @param x1 end column address.
@@ -360,80 +643,119 @@ void st_fill_color(uint16_t color, uint32_t len);
  * @param width width or thickness of the line
  * @param color 16-bit RGB565 color of the line
  */
-void st_draw_line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color);
+void st_draw_line(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color);
 
 /**
  * Experimental
  * Draw a rectangle without filling it
+ * @param disp display
  * @param x start column address.
  * @param y start row address
  * @param w Width of rectangle
  * @param h height of rectangle
  */
-void st_draw_rectangle(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
+void st_draw_rectangle(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
 
 /*
  * Called by st_draw_line().
  * User need not call it
  */
-void _st_plot_line_low(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color);
+void _st_plot_line_low(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color);
 
 /*
  * Called by st_draw_line().
  * User need not call it
  */
-void _st_plot_line_high(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color);
+void _st_plot_line_high(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t width, uint16_t color);
 
 /*
  * Called by st_draw_line().
  * User need not call it
  */
-void _st_draw_fast_h_line(uint16_t x0, uint16_t y0, uint16_t x1, uint8_t width, uint16_t color);
+void _st_draw_fast_h_line(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint8_t width, uint16_t color);
 
 /*
  * Called by st_draw_line().
  * User need not call it
  */
-void _st_draw_fast_v_line(uint16_t x0, uint16_t y0, uint16_t y1, uint8_t width, uint16_t color);
+void _st_draw_fast_v_line(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t y1, uint8_t width, uint16_t color);
 
 /**
  * Rotate the display clockwise or anti-clockwie set by `rotation`
+ * @param disp display
  * @param rotation Type of rotation. Supported values 0, 1, 2, 3
  */
-void st_rotate_display(uint8_t rotation);
+void st_rotate_display(st_display_t *disp, uint8_t rotation);
 
 /**
  * Initialize the display driver
+ * @param disp display with bus and pins set (see ST_DISPLAY_SPI1 and ST_DISPLAY_SPI2)
+ */
+void st_init(st_display_t *disp);
+
+/**
+ * Remove all clip rectangles and move the origin back to the top left corner of the screen.
+ * Called by st_init() and st_rotate_display().
+ * @param disp display
+ */
+void st_reset_clip(st_display_t *disp);
+
+/**
+ * Limit drawing to a rectangle, inside the current clip rectangle.
+ * The current clip rectangle and origin are saved, st_pop_clip() restores them.
+ * @param disp display
+ * @param x start column, relative to the origin
+ * @param y start row, relative to the origin
+ * @param w width
+ * @param h height
+ * @return 1 if done, 0 if the stack is full (ST_CLIP_DEPTH). Don't call st_pop_clip() for a failed push.
+ */
+uint8_t st_push_clip(st_display_t *disp, int16_t x, int16_t y, uint16_t w, uint16_t h);
+
+/**
+ * Restore the clip rectangle and origin saved by the last st_push_clip()
+ * @param disp display
  */
-void st_init();
+void st_pop_clip(st_display_t *disp);
+
+/**
+ * Move the origin, the point drawn at (0,0), to (x,y) of the current drawing coordinates.
+ * Usually called after st_push_clip() with the same x and y, so a widget draws at (0,0).
+ * @param disp display
+ * @param x column of the new origin, relative to the current one
+ * @param y row of the new origin, relative to the current one
+ */
+void st_set_origin(st_display_t *disp, int16_t x, int16_t y);
 
 /**
  * Fills a rectangular area with `color`.
  * Before filling, performs area bound checking
+ * @param disp display
  * @param x Start col address
  * @param y Start row address
  * @param w Width of rectangle
  * @param h Height of rectangle
  * @param color 16-bit RGB565 color
  */
-void st_fill_rect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
+void st_fill_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
 
 /*
- * Same as `st_fill_rect()` but does not do bound checking, so it's slightly faster
+ * Same as `st_fill_rect()`. Clipping is always done now, it's kept for compatibility.
  */
-void st_fill_rect_fast(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
+void st_fill_rect_fast(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
 
 /**
- * Fill the entire display (screen) with `color`
+ * Fill the entire display (screen) with `color`. Only the clip rectangle is filled, if there is one.
+ * @param disp display
  * @param color 16-bit RGB565 color
  */
-void st_fill_screen(uint16_t color);
+void st_fill_screen(st_display_t *disp, uint16_t color);
 
 /*
  * Render a character glyph on the display. Called by `st_draw_string_main()`
  * User need NOT call it
  */
-void _st_render_glyph(uint16_t x, uint16_t y, uint16_t fore_color, uint16_t back_color, const tImage *glyph, uint8_t is_bg);
+void _st_render_glyph(st_display_t *disp, uint16_t x, uint16_t y, uint16_t fore_color, uint16_t back_color, const tImage *glyph, uint8_t is_bg);
 
 /**
  * Renders a string by drawing each character glyph from the passed string.
@@ -443,10 +765,11 @@ void _st_render_glyph(uint16_t x, uint16_t y, uint16_t fore_color, uint16_t back
  * is_bg=1 : Text will habe background color,   is_bg=0 : Text will have transparent background
  * User need NOT call it.
  */
-void _st_draw_string_main(uint16_t x, uint16_t y, char *str, uint16_t fore_color, uint16_t back_color, const tFont *font, uint8_t is_bg);
+void _st_draw_string_main(st_display_t *disp, uint16_t x, uint16_t y, char *str, uint16_t fore_color, uint16_t back_color, const tFont *font, uint8_t is_bg);
 
 /**
  * Draws a character at a given position, fore color, back color.
+ * @param disp display
  * @param x Start col address
  * @param y Start row address
  * @param character the ASCII character to be drawn
@@ -455,22 +778,27 @@ void _st_draw_string_main(uint16_t x, uint16_t y, char *str, uint16_t fore_color
  * @param font Pointer to the font of the character
  * @param is_bg Defines if character has background or not (transparent)
  */
-void st_draw_char(uint16_t x, uint16_t y, char character, uint16_t fore_color, uint16_t back_color, const tFont *font, uint8_t is_bg);
+void st_draw_char(st_display_t *disp, uint16_t x, uint16_t y, char character, uint16_t fore_color, uint16_t back_color, const tFont *font, uint8_t is_bg);
 
 /**
  * Draws a string on the display with `font` and `color` at given position.
- * Background of this string is transparent
+ * Background of this string is transparent. Each column of a glyph is sent as runs of
+ * foreground, and runs repeated in the next columns as one rectangle.
+ * @param disp display
  * @param x Start col address
  * @param y Start y address
  * @param str pointer to the string to be drawn
  * @param color 16-bit RGB565 color of the string
  * @param font Pointer to the font of the string
  */
-void st_draw_string(uint16_t x, uint16_t y, char *str, uint16_t color, const tFont *font);
+void st_draw_string(st_display_t *disp, uint16_t x, uint16_t y, char *str, uint16_t color, const tFont *font);
 
 /**
  * Draws a string on the display with `font`, `fore_color`, and `back_color` at given position.
- * The string has background color
+ * The string has background color. Each character is sent as one window of pixels, column by
+ * column as glyphs are stored (MADCTL MV is flipped while the string is drawn).
+ * Glyphs in the glyph cache are sent from it (see st_set_glyph_cache()).
+ * @param disp display
  * @param x Start col address
  * @param y Start y address
  * @param str pointer to the string to be drawn
@@ -478,23 +806,405 @@ void st_draw_string(uint16_t x, uint16_t y, char *str, uint16_t color, const tFo
  * @param back_color 16-bit RGB565 color of the string's background
  * @param font Pointer to the font of the string
  */
-void st_draw_string_withbg(uint16_t x, uint16_t y, char *str, uint16_t fore_color, uint16_t back_color, const tFont *font);
+void st_draw_string_withbg(st_display_t *disp, uint16_t x, uint16_t y, char *str, uint16_t fore_color, uint16_t back_color, const tFont *font);
+
+#ifdef ST_USE_GLYPH_CACHE
+
+/**
+ * Keep glyphs of text with background expanded in `buffer`. A glyph drawn again with the same font,
+ * character and colors is sent from it by DMA, without expanding its bitmap. When the buffer or
+ * the entries (ST_GLYPH_CACHE_ENTRIES) are full, the least recently drawn glyphs are evicted.
+ * Glyphs only partly inside the clip rectangle are not cached. Statistics are cleared.
+ * @param disp display
+ * @param buffer RGB565 pixels, width x height of each cached glyph (800 for a 20x40 glyph),
+ * NULL to stop caching
+ * @param len size of `buffer` in pixels
+ */
+void st_set_glyph_cache(st_display_t *disp, uint16_t *buffer, uint16_t len);
+
+/**
+ * Get the glyph cache hits, misses and evictions since st_set_glyph_cache(). Few misses
+ * once the screen is drawn mean the buffer is big enough.
+ * @param disp display
+ * @return statistics
+ */
+st_glyph_cache_stats_t st_get_glyph_cache_stats(st_display_t *disp);
+
+#endif
 
 /**
  * Draw a bitmap image on the display
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ * @param bitmap Pointer to the image data to be drawn
+ */
+void st_draw_bitmap(st_display_t *disp, uint16_t x, uint16_t y, const tImage *bitmap);
+
+/**
+ * Draw a 16-bit bitmap image on the display.
+ * Pixels are sent as 16-bit SPI frames straight from `bitmap->data`.
+ * @param disp display
  * @param x Start col address
  * @param y Start row address
  * @param bitmap Pointer to the image data to be drawn
  */
-void st_draw_bitmap(uint16_t x, uint16_t y, const tImage *bitmap);
-//void st_draw_bitmap_old(uint16_t x, uint16_t y, const tImage16bit *bitmap);
+void st_draw_bitmap_16bit(st_display_t *disp, uint16_t x, uint16_t y, const tImage16bit *bitmap);
 
 /**
  * Draw a pixel at a given position with `color`
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ */
+void st_draw_pixel(st_display_t *disp, uint16_t x, uint16_t y, uint16_t color);
+
+/**
+ * Draw many pixels, each with its own color. Much faster than calling st_draw_pixel() for each.
+ * Pixels are sorted by row in batches of ST_PIXELS_BATCH, and adjacent ones are sent together.
+ * If a point is given more than once in a batch, the last one is drawn.
+ * Arrays are not needed after the call returns.
+ * @param disp display
+ * @param points positions of the pixels
+ * @param colors 16-bit RGB565 color of each pixel
+ * @param n number of pixels
+ */
+void st_draw_pixels(st_display_t *disp, const st_point_t *points, const uint16_t *colors, uint16_t n);
+
+/**
+ * Draw many pixels of the same `color`. Same as st_draw_pixels().
+ * @param disp display
+ * @param points positions of the pixels
+ * @param n number of pixels
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_pixels_color(st_display_t *disp, const st_point_t *points, uint16_t n, uint16_t color);
+
+/**
+ * Draw an anti-aliased 1px line from (x0,y0) to (x1,y1) (Xiaolin Wu's algorithm).
+ * Edge pixels are blended with `bg_color`, so the background under the line must be of that color.
+ * @param disp display
+ * @param x0 start column address
+ * @param y0 start row address
+ * @param x1 end column address
+ * @param y1 end row address
+ * @param color 16-bit RGB565 color of the line
+ * @param bg_color 16-bit RGB565 color of the background
+ */
+void st_draw_line_aa(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color, uint16_t bg_color);
+
+/**
+ * Draw an anti-aliased 1px circle. Edge pixels are blended with `bg_color`.
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param color 16-bit RGB565 color of the circle
+ * @param bg_color 16-bit RGB565 color of the background
+ */
+void st_draw_circle_aa(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t color, uint16_t bg_color);
+
+/**
+ * Draw an anti-aliased 1px arc of a circle, clockwise from `start_angle` to `end_angle`.
+ * Angles are in degrees, 0 is at 3 o'clock and 90 at 6 o'clock. Equal angles draw the whole circle.
+ * Edge pixels are blended with `bg_color`.
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param start_angle start of the arc (0 - 359)
+ * @param end_angle end of the arc (0 - 359)
+ * @param color 16-bit RGB565 color of the arc
+ * @param bg_color 16-bit RGB565 color of the background
+ */
+void st_draw_arc_aa(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t start_angle, uint16_t end_angle, uint16_t color, uint16_t bg_color);
+
+/**
+ * Draw a 1px circle
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_circle(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t color);
+
+/**
+ * Draw a filled circle
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_circle(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t color);
+
+/**
+ * Draw a 1px ellipse
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param rx horizontal radius
+ * @param ry vertical radius
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_ellipse(st_display_t *disp, uint16_t x, uint16_t y, uint16_t rx, uint16_t ry, uint16_t color);
+
+/**
+ * Draw a filled ellipse
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param rx horizontal radius
+ * @param ry vertical radius
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_ellipse(st_display_t *disp, uint16_t x, uint16_t y, uint16_t rx, uint16_t ry, uint16_t color);
+
+/**
+ * Draw a filled ring: the pixels of the circle with radius `r_outer` which are not in the
+ * circle with radius `r_inner`
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r_outer outer radius
+ * @param r_inner inner radius, less than `r_outer`
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_ring(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r_outer, uint16_t r_inner, uint16_t color);
+
+/**
+ * Draw a 1px arc of a circle, clockwise from `start_angle` to `end_angle`.
+ * Angles are in degrees, 0 is at 3 o'clock and 90 at 6 o'clock. Equal angles draw the whole circle.
+ * Pixels are the same as those of `st_draw_circle()`.
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r radius
+ * @param start_angle start of the arc (0 - 359)
+ * @param end_angle end of the arc (0 - 359)
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_arc(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r, uint16_t start_angle, uint16_t end_angle, uint16_t color);
+
+/**
+ * Draw a segment of a filled ring (a gauge), clockwise from `start_angle` to `end_angle`.
+ * Angles are in degrees, 0 is at 3 o'clock and 90 at 6 o'clock. Equal angles draw the whole ring.
+ * Pixels are the same as those of `st_fill_ring()`. Each row is a few spans, so a gauge
+ * is a few hundred fills.
+ * @param disp display
+ * @param x center column address
+ * @param y center row address
+ * @param r_outer outer radius
+ * @param r_inner inner radius, less than `r_outer`
+ * @param start_angle start of the segment (0 - 359)
+ * @param end_angle end of the segment (0 - 359)
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_ring_segment(st_display_t *disp, uint16_t x, uint16_t y, uint16_t r_outer, uint16_t r_inner, uint16_t start_angle, uint16_t end_angle, uint16_t color);
+
+/**
+ * Draw a filled rectangle with rounded corners. The straight middle part is one fill,
+ * corners are quarter circles of radius `r` sent as spans.
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ * @param w Width of rectangle
+ * @param h Height of rectangle
+ * @param r radius of the corners, at most half of the width and the height
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_round_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t r, uint16_t color);
+
+/**
+ * Draw a filled polygon. Self-intersecting polygons are filled with the even-odd rule.
+ * A pixel is filled if its center is inside, and pixels on the right or bottom edge are left out,
+ * so polygons sharing an edge don't overlap. Once a row crosses more than ST_POLY_MAX_EDGES edges,
+ * the remaining rows are filled by a slower method.
+ * @param disp display
+ * @param points vertices, may be outside the display
+ * @param n number of vertices
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_polygon(st_display_t *disp, const st_point_t *points, uint16_t n, uint16_t color);
+
+/**
+ * Draw a filled triangle. Same fill rule as `st_fill_polygon()`.
+ * @param disp display
+ * @param x0 column address of the 1st vertex
+ * @param y0 row address of the 1st vertex
+ * @param x1 column address of the 2nd vertex
+ * @param y1 row address of the 2nd vertex
+ * @param x2 column address of the 3rd vertex
+ * @param y2 row address of the 3rd vertex
+ * @param color 16-bit RGB565 color
+ */
+void st_fill_triangle(st_display_t *disp, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color);
+
+/**
+ * Draw connected lines through `points`. Unlike calling st_draw_line() for each segment,
+ * joint pixels are drawn once and straight runs of points are drawn as one line.
+ * A 1px polyline has the same pixels as st_draw_line(). A thicker one is centered on the points,
+ * with `join` at its corners and square (butt) ends.
+ * @param disp display
+ * @param points vertices, may be outside the display
+ * @param n number of vertices
+ * @param width width or thickness of the lines
+ * @param join ST_JOIN_MITER, ST_JOIN_BEVEL or ST_JOIN_ROUND. Miters longer than 2 x `width` are beveled.
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_polyline(st_display_t *disp, const st_point_t *points, uint16_t n, uint8_t width, uint8_t join, uint16_t color);
+
+/**
+ * Start an empty path. Its points are stored in `buffer`.
+ * Subpaths take one more point of the buffer each (see st_path_move_to() and st_path_close()).
+ * @param path path
+ * @param buffer room for the points
+ * @param len number of points in `buffer`
+ */
+void st_path_init(st_path_t *path, st_point_t *buffer, uint16_t len);
+
+/**
+ * Start a new subpath at (x,y)
+ * @param path path
+ * @param x column address
+ * @param y row address
+ * @return 0 if the buffer of the path is full, else 1
+ */
+uint8_t st_path_move_to(st_path_t *path, int16_t x, int16_t y);
+
+/**
+ * Add a line from the last point to (x,y)
+ * @param path path
+ * @param x column address
+ * @param y row address
+ * @return 0 if the buffer of the path is full, else 1
+ */
+uint8_t st_path_line_to(st_path_t *path, int16_t x, int16_t y);
+
+/**
+ * Close the subpath with a line back to its first point, and join its ends
+ * @param path path
+ * @return 0 if the buffer of the path is full, else 1
+ */
+uint8_t st_path_close(st_path_t *path);
+
+/**
+ * Draw the lines of a path. Every subpath is drawn like st_draw_polyline(), and closed ones are
+ * joined at their first point too.
+ * @param disp display
+ * @param path path
+ * @param width width or thickness of the lines
+ * @param join ST_JOIN_MITER, ST_JOIN_BEVEL or ST_JOIN_ROUND
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_path(st_display_t *disp, const st_path_t *path, uint8_t width, uint8_t join, uint16_t color);
+
+/**
+ * Draw a quadratic Bezier curve from (x0,y0) to (x2,y2), pulled toward the control point (x1,y1).
+ * The curve is drawn with st_draw_polyline() as the fewest lines that stay within
+ * ST_BEZIER_TOLERANCE of it. No floating point math is used.
+ * @param disp display
+ * @param x0 start column address
+ * @param y0 start row address
+ * @param x1 control point column address
+ * @param y1 control point row address
+ * @param x2 end column address
+ * @param y2 end row address
+ * @param width width or thickness of the curve
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_bezier2(st_display_t *disp, int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t width, uint16_t color);
+
+/**
+ * Draw a cubic Bezier curve from (x0,y0) to (x3,y3), leaving in the direction of (x1,y1)
+ * and arriving from the direction of (x2,y2). Drawn like st_draw_bezier2().
+ * @param disp display
+ * @param x0 start column address
+ * @param y0 start row address
+ * @param x1 first control point column address
+ * @param y1 first control point row address
+ * @param x2 second control point column address
+ * @param y2 second control point row address
+ * @param x3 end column address
+ * @param y3 end row address
+ * @param width width or thickness of the curve
+ * @param color 16-bit RGB565 color
+ */
+void st_draw_bezier3(st_display_t *disp, int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint8_t width, uint16_t color);
+
+/**
+ * Fill a rectangle with a gradient from `color1` to `color2`.
+ * Vertical: color1 at the top row, color2 at the bottom row.
+ * Horizontal: color1 at the left column, color2 at the right column.
+ * Radial: color1 at the center, color2 at the corners.
+ * The whole rectangle is one address window. Generated lines go through two buffers in turn,
+ * so the next one is generated while the last one is sent. Rows of one color (vertical)
+ * and repeated rows (horizontal) are not generated at all, unless dithered.
+ * @param disp display
+ * @param x Start col address
+ * @param y Start row address
+ * @param w Width of rectangle
+ * @param h Height of rectangle
+ * @param color1 16-bit RGB565 color at the start
+ * @param color2 16-bit RGB565 color at the end
+ * @param type ST_GRADIENT_VERTICAL, ST_GRADIENT_HORIZONTAL or ST_GRADIENT_RADIAL.
+ *        Add ST_GRADIENT_DITHER to hide the steps between RGB565 colors.
+ */
+void st_fill_gradient_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color1, uint16_t color2, uint8_t type);
+
+/**
+ * Fill a rectangle with copies of a small pattern tile (checkerboard, hatching, stripes...).
+ * The top left corner of the rectangle gets the top left pixel of the tile.
+ * The rectangle is cut into vertical strips whose data repeats every `tile_h` rows. One copy of
+ * that data is built, and each strip is sent from it by one circular DMA transfer. So the work
+ * does not grow with the height. Only the last rows (less than `tile_h`) are built row by row.
+ * Strips are widest if `tile_w * tile_h` is small compared to ST_PIXBUF_LEN / 2. Larger tiles
+ * are built row by row.
+ * The tile is copied, so it can be changed as soon as the function returns.
+ * @param disp display
  * @param x Start col address
  * @param y Start row address
+ * @param w Width of rectangle
+ * @param h Height of rectangle
+ * @param tile `tile_w` x `tile_h` RGB565 pixels, row by row
+ * @param tile_w width of the tile
+ * @param tile_h height of the tile
+ */
+void st_fill_pattern_rect(st_display_t *disp, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t *tile, uint8_t tile_w, uint8_t tile_h);
+
+#ifdef ST_USE_SHADOW
+
+/**
+ * Keep a shadow of the screen in `buffer`, so st_flood_fill() doesn't have to read the panel.
+ * Every pixel takes `bpp` bits, telling which of `colors` it has, or none of them. Everything
+ * drawn from now on is tracked. The buffer is cleared (no color), so set it before drawing the screen.
+ * @param disp display
+ * @param buffer width x height x bpp / 8 bytes (7200 for 240x240 at 1 bpp), NULL to stop using a shadow
+ * @param bpp bits per pixel, 1 or 2
+ * @param colors 1 color (1 bpp) or 3 colors (2 bpp) that st_flood_fill() tells apart
+ */
+void st_set_shadow(st_display_t *disp, uint8_t *buffer, uint8_t bpp, const uint16_t *colors);
+
+#endif
+
+/**
+ * Fill the region around (x,y) with `color`: every pixel that can be reached from (x,y) through
+ * pixels of the same color, going up, down, left or right, inside the clip rectangle.
+ * Pixels are read from the shadow if there is one (see st_set_shadow()), where all colors it
+ * doesn't know count as one. Else they're read back from the panel over SDA, so the panel's SDA
+ * must be readable (3-wire SPI) and the display needs a CS pin (`cs`), as only CS high ends a
+ * read. Filled spans are sent as single fills.
+ * Regions more complex than ST_FLOOD_STACK allows are finished by rescanning where spans were
+ * dropped. Parts of them only reachable past rows that already had `color` may be left out.
+ * @param disp display
+ * @param x column of a pixel in the region
+ * @param y row of a pixel in the region
+ * @param color 16-bit RGB565 color
+ * @return 0 if nothing is filled because neither `color` nor the region's color is known to the
+ * shadow, or because there is no shadow and no CS pin, else 1
  */
-void st_draw_pixel(uint16_t x, uint16_t y, uint16_t color);
+uint8_t st_flood_fill(st_display_t *disp, int16_t x, int16_t y, uint16_t color);
 
 //------------------------------------------------------------------------
 #endif /* INC_ST7789_STM32_SPI_H_ */